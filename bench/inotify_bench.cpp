@@ -0,0 +1,781 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+// end-to-end benchmark: starts inotify_watcher on a tmpfs directory with a generated config,
+// the job command is this binary in the sink mode, it reports the command start time to the fifo
+
+#include <poll.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+namespace Bench {
+    const char* SINK_ENV = "INOTIFY_BENCH_SINK";
+
+    uint64_t monotonicNs(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, & ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    // the record is less than PIPE_BUF: the writes of the parallel commands are not mixed
+    void sinkWrite(int fd, std::string_view path) {
+        auto line = std::to_string(monotonicNs()).append(" ").append(path).append("\n");
+
+        if(line.size() <= PIPE_BUF && 0 > write(fd, line.data(), line.size())) {
+            std::cerr << "sink: write failed, error: " << strerror(errno) << std::endl;
+        }
+    }
+
+    // exec mode: sink EVENT "path"
+    // worker mode: sink < {"event":..,"path":"..","time":..}\n
+    int runSink(const char* fifo, int argc, char** argv) {
+        int fd = open(fifo, O_WRONLY | O_CLOEXEC);
+
+        if(0 > fd) {
+            std::cerr << "sink: open failed, error: " << strerror(errno) << ", path: " << fifo << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(3 <= argc) {
+            std::string_view path{argv[2]};
+
+            // unescaped job: std::quoted
+            if(2 <= path.size() && path.front() == '"' && path.back() == '"') {
+                path = path.substr(1, path.size() - 2);
+            }
+
+            sinkWrite(fd, path);
+        } else {
+            std::string line;
+
+            while(std::getline(std::cin, line)) {
+                const std::string_view key{"\"path\":\""};
+
+                if(auto pos = line.find(key); pos != std::string::npos) {
+                    pos += key.size();
+
+                    if(auto end = line.find('"', pos); end != std::string::npos) {
+                        sinkWrite(fd, std::string_view(line).substr(pos, end - pos));
+                    }
+                }
+            }
+        }
+
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+
+    struct Options {
+        std::filesystem::path watcher;
+        std::filesystem::path base{"/dev/shm"};
+        std::string mode{"exec"};
+        std::string backend{"inotify"};
+        std::string engine{"epoll"};
+        std::vector<std::string> workloads{"create", "modify", "tree", "rename"};
+        size_t count = 1000;
+        size_t rate = 0;
+        size_t burst = 10;
+        size_t depth = 16;
+        size_t threads = 4;
+        size_t instances = 1;
+        size_t maxParallel = 64;
+        size_t maxQueue = 4096;
+        std::chrono::milliseconds settle{2000};
+    };
+
+    // matches the sink records with the pending operations
+    class Collector {
+        std::unordered_map<std::string, std::deque<uint64_t>> pending_;
+        std::vector<uint64_t> latencies_;
+        mutable std::mutex lock_;
+
+        std::atomic<size_t> delivered_{0};
+        std::atomic<size_t> unmatched_{0};
+        std::atomic<uint64_t> lastArrival_{0};
+        std::atomic<bool> shutdown_{false};
+
+        std::thread thread_;
+        int fd_ = -1;
+
+        void parseLine(std::string_view line) {
+            auto pos = line.find(' ');
+
+            if(pos == std::string_view::npos) {
+                return;
+            }
+
+            uint64_t arrival = std::strtoull(std::string(line.substr(0, pos)).c_str(), nullptr, 10);
+            std::string path{line.substr(pos + 1)};
+
+            std::scoped_lock guard{ lock_ };
+            auto it = pending_.find(path);
+
+            if(it == pending_.end() || it->second.empty()) {
+                unmatched_++;
+                return;
+            }
+
+            // the coalesced events are matched with the oldest operation
+            if(arrival > it->second.front()) {
+                latencies_.push_back(arrival - it->second.front());
+            } else {
+                latencies_.push_back(0);
+            }
+
+            it->second.pop_front();
+
+            if(it->second.empty()) {
+                pending_.erase(it);
+            }
+
+            lastArrival_ = arrival;
+            delivered_++;
+        }
+
+        void readLoop(void) {
+            std::string buf;
+            char tmp[4096];
+
+            while(! shutdown_) {
+                struct pollfd pfd = { fd_, POLLIN, 0 };
+
+                if(0 >= poll(& pfd, 1, 100)) {
+                    continue;
+                }
+
+                auto len = read(fd_, tmp, sizeof(tmp));
+
+                if(0 >= len) {
+                    continue;
+                }
+
+                buf.append(tmp, len);
+                size_t start = 0;
+
+                for(auto end = buf.find('\n'); end != std::string::npos; end = buf.find('\n', start)) {
+                    parseLine(std::string_view(buf).substr(start, end - start));
+                    start = end + 1;
+                }
+
+                buf.erase(0, start);
+            }
+        }
+
+    public:
+        explicit Collector(const std::filesystem::path & fifo) {
+            // O_RDWR: no EOF between the commands
+            fd_ = open(fifo.c_str(), O_RDWR | O_CLOEXEC);
+
+            if(0 > fd_) {
+                throw std::runtime_error(std::string("fifo open failed: ").append(strerror(errno)));
+            }
+
+            thread_ = std::thread(& Collector::readLoop, this);
+        }
+
+        ~Collector() {
+            shutdown_ = true;
+            thread_.join();
+            close(fd_);
+        }
+
+        // before the operation: the record may arrive before the syscall returns
+        void expect(const std::string & path, uint64_t start) {
+            std::scoped_lock guard{ lock_ };
+            pending_[path].push_back(start);
+        }
+
+        void reset(void) {
+            std::scoped_lock guard{ lock_ };
+            pending_.clear();
+            latencies_.clear();
+            delivered_ = 0;
+            unmatched_ = 0;
+            lastArrival_ = 0;
+        }
+
+        size_t delivered(void) const {
+            return delivered_;
+        }
+
+        size_t unmatched(void) const {
+            return unmatched_;
+        }
+
+        uint64_t lastArrival(void) const {
+            return lastArrival_;
+        }
+
+        std::vector<uint64_t> latencies(void) const {
+            std::scoped_lock guard{ lock_ };
+            auto res = latencies_;
+            std::sort(res.begin(), res.end());
+            return res;
+        }
+    };
+
+    struct ProcStats {
+        size_t rssKb = 0;
+        size_t hwmKb = 0;
+        size_t fds = 0;
+        double cpuSec = 0;
+    };
+
+    ProcStats procStats(pid_t pid) {
+        ProcStats res;
+        auto proc = std::filesystem::path("/proc") / std::to_string(pid);
+        std::ifstream status(proc / "status");
+        std::string line;
+
+        while(std::getline(status, line)) {
+            if(0 == line.compare(0, 6, "VmRSS:")) {
+                res.rssKb = std::strtoul(line.c_str() + 6, nullptr, 10);
+            } else if(0 == line.compare(0, 6, "VmHWM:")) {
+                res.hwmKb = std::strtoul(line.c_str() + 6, nullptr, 10);
+            }
+        }
+
+        std::error_code err;
+
+        for(auto it = std::filesystem::directory_iterator(proc / "fd", err); ! err && it != std::filesystem::directory_iterator(); it.increment(err)) {
+            res.fds++;
+        }
+
+        // utime, stime: the fields 14, 15, after the comm in parentheses
+        std::ifstream stat(proc / "stat");
+
+        if(std::getline(stat, line)) {
+            if(auto pos = line.rfind(')'); pos != std::string::npos) {
+                std::istringstream is(line.substr(pos + 2));
+                std::string field;
+                unsigned long utime = 0, stime = 0;
+
+                for(int it = 3; it <= 15 && is >> field; ++it) {
+                    if(it == 14) {
+                        utime = std::stoul(field);
+                    } else if(it == 15) {
+                        stime = std::stoul(field);
+                    }
+                }
+
+                res.cpuSec = static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+            }
+        }
+
+        return res;
+    }
+
+    // the prometheus textfile: sum of the metric over the labels
+    uint64_t metricSum(const std::filesystem::path & file, std::string_view name) {
+        std::ifstream is(file);
+        std::string line;
+        uint64_t res = 0;
+
+        while(std::getline(is, line)) {
+            if(0 == line.compare(0, name.size(), name) && line.size() > name.size() &&
+                    (line[name.size()] == ' ' || line[name.size()] == '{')) {
+                if(auto pos = line.rfind(' '); pos != std::string::npos) {
+                    res += std::strtoull(line.c_str() + pos + 1, nullptr, 10);
+                }
+            }
+        }
+
+        return res;
+    }
+
+    struct Result {
+        std::string workload;
+        size_t ops = 0;
+        size_t delivered = 0;
+        size_t dropped = 0;
+        size_t overflows = 0;
+        // INOTIFY_WATCHER_ALLOC_COUNT build only
+        size_t allocs = 0;
+        bool allocCount = false;
+        double seconds = 0;
+        double p50 = 0;
+        double p99 = 0;
+        double max = 0;
+        ProcStats proc;
+    };
+
+    class Runner {
+        const Options & opts_;
+        std::filesystem::path root_;
+        std::filesystem::path watch_;
+        std::filesystem::path fifo_;
+        std::filesystem::path metrics_;
+        pid_t pid_ = -1;
+
+        // operations paced to the rate, 0: unlimited
+        void pace(uint64_t start, size_t index) const {
+            if(opts_.rate) {
+                auto due = start + index * 1000000000ull / opts_.rate;
+                auto now = monotonicNs();
+
+                if(due > now) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+                }
+            }
+        }
+
+        static void writeFile(const std::filesystem::path & path, const char* data) {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+            if(0 > fd) {
+                throw std::runtime_error(std::string("open failed: ").append(strerror(errno)).append(", path: ").append(path.native()));
+            }
+
+            if(0 > write(fd, data, strlen(data))) {
+                std::cerr << "write failed, error: " << strerror(errno) << std::endl;
+            }
+
+            close(fd);
+        }
+
+        std::string jobEvents(const std::string & workload) const {
+            // IN_CLOSE_WRITE: the ready probe
+            if(workload == "modify") {
+                return R"("IN_CLOSE_WRITE", "IN_MODIFY")";
+            }
+
+            if(workload == "rename") {
+                return R"("IN_CLOSE_WRITE", "IN_MOVED_TO")";
+            }
+
+            return R"("IN_CLOSE_WRITE")";
+        }
+
+        void writeConfig(const std::string & workload, const std::filesystem::path & self) const {
+            std::ofstream os(root_ / "config.json");
+
+            os << "{\n" <<
+               "    \"debug\": false,\n" <<
+               "    \"threads\": " << opts_.threads << ",\n" <<
+               "    \"io_engine\": " << std::quoted(opts_.engine) << ",\n" <<
+               "    \"inotify_instances\": " << opts_.instances << ",\n" <<
+               "    \"max_parallel\": " << opts_.maxParallel << ",\n" <<
+               "    \"max_queue\": " << opts_.maxQueue << ",\n" <<
+               "    \"metrics_file\": " << std::quoted(metrics_.native()) << ",\n" <<
+               "    \"metrics_interval\": 1,\n" <<
+               "    \"jobs\": [\n" <<
+               "        {\n" <<
+               "            \"path\": " << std::quoted(watch_.native()) << ",\n" <<
+               "            \"inotify\": [ " << jobEvents(workload) << " ],\n" <<
+               "            \"recursive\": " << (workload == "tree" ? "true" : "false") << ",\n" <<
+               "            \"backend\": " << std::quoted(opts_.backend) << ",\n" <<
+               "            \"mode\": " << std::quoted(opts_.mode) << ",\n" <<
+               "            \"command\": " << std::quoted(self.native()) << "\n" <<
+               "        }\n" <<
+               "    ]\n" <<
+               "}\n";
+        }
+
+        void startWatcher(void) {
+            auto conf = root_ / "config.json";
+            auto jobs = root_ / "jobs.d";
+
+            std::filesystem::create_directories(jobs);
+
+            setenv("INOTIFY_JOBS_DIR", jobs.c_str(), 1);
+            setenv(SINK_ENV, fifo_.c_str(), 1);
+
+            pid_ = fork();
+
+            if(0 > pid_) {
+                throw std::runtime_error(std::string("fork failed: ").append(strerror(errno)));
+            }
+
+            if(0 == pid_) {
+                execl(opts_.watcher.c_str(), opts_.watcher.c_str(), "--config", conf.c_str(), nullptr);
+                _exit(127);
+            }
+
+            unsetenv(SINK_ENV);
+        }
+
+        void stopWatcher(void) {
+            if(0 > pid_) {
+                return;
+            }
+
+            kill(pid_, SIGTERM);
+
+            for(int it = 0; it < 50; ++it) {
+                if(pid_ == waitpid(pid_, nullptr, WNOHANG)) {
+                    pid_ = -1;
+                    return;
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+
+            kill(pid_, SIGKILL);
+            waitpid(pid_, nullptr, 0);
+            pid_ = -1;
+        }
+
+        bool waitReady(Collector & collector) {
+            // the probe files until the first command
+            for(int it = 0; it < 100; ++it) {
+                if(0 == pid_ || pid_ == waitpid(pid_, nullptr, WNOHANG)) {
+                    pid_ = -1;
+                    return false;
+                }
+
+                auto probe = watch_ / (".ready" + std::to_string(it));
+                collector.expect(probe.native(), monotonicNs());
+                writeFile(probe, "");
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+                if(collector.delivered()) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        void waitSettle(Collector & collector, size_t expected) const {
+            size_t last = collector.delivered();
+            auto quiet = std::chrono::steady_clock::now();
+
+            while(collector.delivered() < expected) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+                if(auto cur = collector.delivered(); cur != last) {
+                    last = cur;
+                    quiet = std::chrono::steady_clock::now();
+                } else if(std::chrono::steady_clock::now() - quiet > opts_.settle) {
+                    break;
+                }
+            }
+        }
+
+        void prepare(const std::string & workload) {
+            if(workload == "modify") {
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    writeFile(watch_ / ("m" + std::to_string(it)), "");
+                }
+            } else if(workload == "rename") {
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    writeFile(watch_ / ("a" + std::to_string(it)), "");
+                }
+            }
+        }
+
+        size_t drive(const std::string & workload, Collector & collector, uint64_t start) {
+            size_t ops = 0;
+
+            if(workload == "create") {
+                // N new files: IN_CLOSE_WRITE
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    pace(start, ops);
+                    auto path = watch_ / ("c" + std::to_string(it));
+                    collector.expect(path.native(), monotonicNs());
+                    writeFile(path, "x");
+                    ops++;
+                }
+            } else if(workload == "modify") {
+                // the bursts of writes to the open files: IN_MODIFY
+                std::vector<int> fds;
+
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    fds.push_back(open((watch_ / ("m" + std::to_string(it))).c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+                }
+
+                for(size_t round = 0; round < opts_.burst; ++round) {
+                    for(size_t it = 0; it < fds.size(); ++it) {
+                        pace(start, ops);
+                        collector.expect((watch_ / ("m" + std::to_string(it))).native(), monotonicNs());
+
+                        if(0 > write(fds[it], "x", 1)) {
+                            std::cerr << "write failed, error: " << strerror(errno) << std::endl;
+                        }
+
+                        ops++;
+                    }
+                }
+
+                for(auto fd : fds) {
+                    // the IN_CLOSE_WRITE are not expected
+                    close(fd);
+                }
+            } else if(workload == "tree") {
+                // mkdir -p of the deep trees and the file in the leaf: the race of the new directory watches
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    pace(start, ops);
+                    auto dir = watch_ / ("t" + std::to_string(it));
+
+                    for(size_t level = 0; level < opts_.depth; ++level) {
+                        dir /= "d" + std::to_string(level);
+                    }
+
+                    auto path = dir / "leaf";
+                    collector.expect(path.native(), monotonicNs());
+                    std::filesystem::create_directories(dir);
+                    writeFile(path, "x");
+                    ops++;
+                }
+            } else if(workload == "rename") {
+                // the rename storm: IN_MOVED_TO
+                for(size_t it = 0; it < opts_.count; ++it) {
+                    pace(start, ops);
+                    auto from = watch_ / ("a" + std::to_string(it));
+                    auto to = watch_ / ("b" + std::to_string(it));
+                    collector.expect(to.native(), monotonicNs());
+                    std::filesystem::rename(from, to);
+                    ops++;
+                }
+            }
+
+            return ops;
+        }
+
+    public:
+        Runner(const Options & opts, const std::filesystem::path & root) : opts_(opts), root_(root) {}
+
+        ~Runner() {
+            stopWatcher();
+        }
+
+        Result run(const std::string & workload, const std::filesystem::path & self) {
+            Result res;
+            res.workload = workload;
+
+            root_ /= workload;
+            watch_ = root_ / "watch";
+            fifo_ = root_ / "sink.fifo";
+            metrics_ = root_ / "metrics.prom";
+
+            std::filesystem::create_directories(watch_);
+
+            if(0 > mkfifo(fifo_.c_str(), 0600)) {
+                throw std::runtime_error(std::string("mkfifo failed: ").append(strerror(errno)));
+            }
+
+            writeConfig(workload, self);
+            prepare(workload);
+
+            Collector collector(fifo_);
+            startWatcher();
+
+            if(! waitReady(collector)) {
+                throw std::runtime_error("watcher not ready, workload: " + workload);
+            }
+
+            // the probe allocations are written to the metrics
+            std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+
+            collector.reset();
+            auto before = metricSum(metrics_, "inotify_watcher_commands_dropped_total");
+            auto allocs = metricSum(metrics_, "inotify_watcher_heap_allocations_total");
+
+            auto start = monotonicNs();
+            res.ops = drive(workload, collector, start);
+            waitSettle(collector, res.ops);
+
+            res.delivered = collector.delivered();
+            auto last = collector.lastArrival();
+            res.seconds = static_cast<double>((last > start ? last : monotonicNs()) - start) / 1e9;
+
+            if(auto lat = collector.latencies(); ! lat.empty()) {
+                res.p50 = lat[lat.size() / 2] / 1e6;
+                res.p99 = lat[std::min(lat.size() - 1, lat.size() * 99 / 100)] / 1e6;
+                res.max = lat.back() / 1e6;
+            }
+
+            // the next metrics textfile
+            std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+
+            res.proc = procStats(pid_);
+            res.dropped = metricSum(metrics_, "inotify_watcher_commands_dropped_total") - before;
+            res.overflows = metricSum(metrics_, "inotify_watcher_queue_overflows_total");
+
+            if(auto val = metricSum(metrics_, "inotify_watcher_heap_allocations_total")) {
+                res.allocCount = true;
+                res.allocs = val - allocs;
+            }
+
+            stopWatcher();
+            return res;
+        }
+    };
+
+    void printUsage(const char* name) {
+        std::cout << "usage: " << name << " [options]" << std::endl <<
+                  "    --watcher <path>      inotify_watcher binary (default: near this binary)" << std::endl <<
+                  "    --dir <path>          tmpfs base directory (default: /dev/shm)" << std::endl <<
+                  "    --mode <mode>         job mode: exec, worker (default: exec)" << std::endl <<
+                  "    --backend <backend>   job backend: inotify, fanotify (default: inotify)" << std::endl <<
+                  "    --engine <engine>     watcher io_engine: epoll, io_uring (default: epoll)" << std::endl <<
+                  "    --instances <num>     watcher inotify_instances (default: 1)" << std::endl <<
+                  "    --workload <list>     comma separated: create, modify, tree, rename (default: all)" << std::endl <<
+                  "    --count <num>         files or trees per workload (default: 1000)" << std::endl <<
+                  "    --rate <num>          operations per second, 0: unlimited (default: 0)" << std::endl <<
+                  "    --burst <num>         writes per file of the modify workload (default: 10)" << std::endl <<
+                  "    --depth <num>         directory depth of the tree workload (default: 16)" << std::endl <<
+                  "    --threads <num>       watcher threads (default: 4)" << std::endl <<
+                  "    --max-parallel <num>  watcher max_parallel (default: 64)" << std::endl <<
+                  "    --max-queue <num>     watcher max_queue (default: 4096)" << std::endl <<
+                  "    --settle <ms>         wait for the last events (default: 2000)" << std::endl;
+    }
+
+    bool parseOptions(int argc, char** argv, Options & opts) {
+        for(int it = 1; it < argc; ++it) {
+            std::string_view key{argv[it]};
+
+            if(key == "--help") {
+                return false;
+            }
+
+            if(it + 1 >= argc) {
+                std::cerr << "value not found: " << key << std::endl;
+                return false;
+            }
+
+            std::string val{argv[++it]};
+
+            if(key == "--watcher") {
+                opts.watcher = val;
+            } else if(key == "--dir") {
+                opts.base = val;
+            } else if(key == "--mode") {
+                opts.mode = val;
+            } else if(key == "--backend") {
+                opts.backend = val;
+            } else if(key == "--engine") {
+                opts.engine = val;
+            } else if(key == "--instances") {
+                opts.instances = std::stoul(val);
+            } else if(key == "--workload") {
+                opts.workloads.clear();
+                std::istringstream is(val);
+
+                for(std::string name; std::getline(is, name, ',');) {
+                    opts.workloads.emplace_back(name);
+                }
+            } else if(key == "--count") {
+                opts.count = std::stoul(val);
+            } else if(key == "--rate") {
+                opts.rate = std::stoul(val);
+            } else if(key == "--burst") {
+                opts.burst = std::stoul(val);
+            } else if(key == "--depth") {
+                opts.depth = std::stoul(val);
+            } else if(key == "--threads") {
+                opts.threads = std::stoul(val);
+            } else if(key == "--max-parallel") {
+                opts.maxParallel = std::stoul(val);
+            } else if(key == "--max-queue") {
+                opts.maxQueue = std::stoul(val);
+            } else if(key == "--settle") {
+                opts.settle = std::chrono::milliseconds(std::stoul(val));
+            } else {
+                std::cerr << "unknown option: " << key << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if(auto fifo = getenv(Bench::SINK_ENV)) {
+        return Bench::runSink(fifo, argc, argv);
+    }
+
+    Bench::Options opts;
+
+    if(! Bench::parseOptions(argc, argv, opts)) {
+        Bench::printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto self = std::filesystem::read_symlink("/proc/self/exe");
+
+    if(opts.watcher.empty()) {
+        opts.watcher = self.parent_path() / "inotify_watcher";
+    }
+
+    if(! std::filesystem::is_regular_file(opts.watcher)) {
+        std::cerr << "watcher not found: " << opts.watcher.native() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // the commands may exit before the sink read
+    signal(SIGPIPE, SIG_IGN);
+
+    auto root = opts.base / ("inotify_bench." + std::to_string(getpid()));
+    std::vector<Bench::Result> results;
+    int ret = EXIT_SUCCESS;
+
+    for(auto & workload : opts.workloads) {
+        try {
+            Bench::Runner runner(opts, root);
+            results.emplace_back(runner.run(workload, self));
+        } catch(const std::exception & err) {
+            std::cerr << "workload: " << workload << ", exception: " << err.what() << std::endl;
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::remove_all(root, err);
+
+    std::printf("mode: %s, backend: %s, engine: %s, instances: %zu, count: %zu, rate: %zu, threads: %zu\n",
+                opts.mode.c_str(), opts.backend.c_str(), opts.engine.c_str(), opts.instances, opts.count, opts.rate, opts.threads);
+    std::printf("%-8s %8s %9s %7s %7s %9s %10s %9s %9s %9s %9s %9s %5s %7s %9s\n",
+                "workload", "ops", "delivered", "missed", "dropped", "overflows", "events/s",
+                "p50 ms", "p99 ms", "max ms", "rss KB", "hwm KB", "fds", "cpu s", "allocs/ev");
+
+    for(auto & res : results) {
+        char allocs[32] = "-";
+
+        // the whole watcher: the exec mode allocates for the spawn
+        if(res.allocCount && res.delivered) {
+            std::snprintf(allocs, sizeof(allocs), "%.3f", static_cast<double>(res.allocs) / res.delivered);
+        }
+
+        std::printf("%-8s %8zu %9zu %7zu %7zu %9zu %10.0f %9.3f %9.3f %9.3f %9zu %9zu %5zu %7.2f %9s\n",
+                    res.workload.c_str(), res.ops, res.delivered, res.ops - std::min(res.ops, res.delivered),
+                    res.dropped, res.overflows, res.seconds > 0 ? res.delivered / res.seconds : 0.0,
+                    res.p50, res.p99, res.max, res.proc.rssKb, res.proc.hwmKb, res.proc.fds, res.proc.cpuSec, allocs);
+    }
+
+    return ret;
+}
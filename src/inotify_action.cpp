@@ -0,0 +1,663 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/fsuid.h>
+#include <sys/syscall.h>
+
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <filesystem>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_tools.h"
+#include "inotify_worker.h"
+#include "inotify_plugin.h"
+#include "inotify_action.h"
+
+using namespace boost;
+
+namespace Inotify {
+    static std::string jsonString(const json::object & jo, std::string_view key, const std::string & def) {
+        if(auto val = jo.if_contains(key)) {
+            return json::value_to<std::string>(*val);
+        }
+
+        return def;
+    }
+
+    static uint64_t unixTimeNs(void) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /// the action thread as the owner: the kernel checks the access of the owner, the created files are its own
+    /// setfsuid, setfsgid and the raw setgroups are per thread, the pool thread is restored by the destructor
+    class FsCredentials : boost::noncopyable {
+        const System::CredentialsPtr & owner_;
+        std::vector<gid_t> groups_;
+        bool success_ = true;
+
+      public:
+        explicit FsCredentials(const System::CredentialsPtr & owner) : owner_(owner) {
+            if(! owner_) {
+                return;
+            }
+
+            if(int count = getgroups(0, nullptr); 0 < count) {
+                groups_.resize(count);
+                groups_.resize(std::max(getgroups(count, groups_.data()), 0));
+            }
+
+            // the glibc setgroups changes all threads, the same groups as the command
+            gid_t gid = owner_->gid;
+            syscall(SYS_setgroups, 1, & gid);
+
+            setfsgid(owner_->gid);
+            setfsuid(owner_->uid);
+
+            // the previous value is returned: the second call checks the first
+            success_ = static_cast<uid_t>(setfsuid(owner_->uid)) == owner_->uid;
+        }
+
+        ~FsCredentials() {
+            if(! owner_) {
+                return;
+            }
+
+            // the fs capabilities are restored with the fsuid 0
+            setfsuid(geteuid());
+            setfsgid(getegid());
+            syscall(SYS_setgroups, groups_.size(), groups_.data());
+        }
+
+        explicit operator bool(void) const {
+            return success_;
+        }
+    };
+
+    static bool writeAll(int fd, const char* ptr, size_t len) {
+        while(len) {
+            auto res = write(fd, ptr, len);
+
+            if(0 > res) {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            ptr += res;
+            len -= res;
+        }
+
+        return true;
+    }
+
+    /// the line per event to the log file, reopened after the rotation
+    /// opened as the owner: the file it may not write is not written, the created file is its own
+    class AppendAction : public Action {
+        const std::string file_;
+        const bool json_;
+        System::CredentialsPtr owner_;
+
+        int fd_ = -1;
+        ino_t inode_ = 0;
+        std::string line_;
+        uint64_t failed_ = 0;
+
+      protected:
+        bool open(void) {
+            if(0 <= fd_) {
+                close(fd_);
+                fd_ = -1;
+            }
+
+            FsCredentials creds{owner_};
+
+            if(! creds) {
+                spdlog::error("{}: {} failed, uid: {}, path: {}", __FUNCTION__, "setfsuid", owner_->uid, file_);
+                return false;
+            }
+
+            fd_ = ::open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+
+            if(0 > fd_) {
+                spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, file_);
+                return false;
+            }
+
+            struct stat st;
+
+            if(0 == fstat(fd_, & st)) {
+                inode_ = st.st_ino;
+            }
+
+            return true;
+        }
+
+      public:
+        AppendAction(const std::string & file, bool json, const System::CredentialsPtr & owner)
+            : file_(file), json_(json), owner_(owner) {
+            if(! open()) {
+                throw std::invalid_argument(std::string("append file not opened: ").append(file));
+            }
+        }
+
+        ~AppendAction() {
+            if(0 <= fd_) {
+                close(fd_);
+            }
+        }
+
+        bool run(const std::string & path, uint32_t mask, const std::string & from) override {
+            struct stat st;
+
+            // the logrotate: moved or removed
+            if(0 > fd_ || 0 > stat(file_.c_str(), & st) || st.st_ino != inode_) {
+                if(! open()) {
+                    return false;
+                }
+            }
+
+            if(json_) {
+                System::formatRecord(line_, System::WorkerFormat::Json, path, mask, from);
+            } else {
+                // EVENT "path" ["from"]
+                line_.assign(maskToString(mask)).append(" ").append(String::quoted(path, false));
+
+                if(from.size()) {
+                    line_.append(" ").append(String::quoted(from, false));
+                }
+
+                line_.push_back('\n');
+            }
+
+            // O_APPEND: the line is not split by the other writers
+            if(! writeAll(fd_, line_.data(), line_.size())) {
+                if(System::logThrottled(failed_)) {
+                    spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "write", strerror(errno), errno, file_);
+                }
+
+                return false;
+            }
+
+            return true;
+        }
+
+        const char* type(void) const override {
+            return "append";
+        }
+    };
+
+    /// the file to the spool dir: the hardlink or the copy, replaced by rename
+    /// as the owner: the event path is opened with its access, the symlink swap gives it nothing it may not read
+    class SpoolAction : public Action {
+        const std::filesystem::path dir_;
+        const bool copy_;
+        const bool unique_;
+        System::CredentialsPtr owner_;
+        uint64_t failed_ = 0;
+        bool crossDevice_ = false;
+
+      protected:
+        bool copyFile(int src, const std::string & tmp, mode_t mode) {
+            // the source mode, without setuid and setgid
+            int dst = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode & 0777);
+
+            if(0 > dst) {
+                return false;
+            }
+
+            bool res = true;
+            bool fallback = false;
+
+            // in kernel, the reflink on the same fs
+            while(true) {
+                auto len = copy_file_range(src, nullptr, dst, nullptr, 1024 * 1024 * 1024, 0);
+
+                if(0 == len) {
+                    break;
+                }
+
+                if(0 > len) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+
+                    fallback = errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP;
+                    res = false;
+                    break;
+                }
+            }
+
+            if(fallback && 0 == lseek(src, 0, SEEK_SET) && 0 == ftruncate(dst, 0)) {
+                char buf[64 * 1024];
+                res = true;
+
+                while(true) {
+                    auto len = read(src, buf, sizeof(buf));
+
+                    if(0 > len && errno == EINTR) {
+                        continue;
+                    }
+
+                    if(0 >= len) {
+                        res = 0 == len;
+                        break;
+                    }
+
+                    if(! writeAll(dst, buf, len)) {
+                        res = false;
+                        break;
+                    }
+                }
+            }
+
+            close(dst);
+            return res;
+        }
+
+      public:
+        SpoolAction(const std::filesystem::path & dir, bool copy, bool unique, const System::CredentialsPtr & owner)
+            : dir_(dir), copy_(copy), unique_(unique), owner_(owner) {
+            if(! std::filesystem::is_directory(dir_)) {
+                throw std::invalid_argument(std::string("spool dir not found: ").append(dir_.native()));
+            }
+        }
+
+        bool run(const std::string & path, uint32_t mask, const std::string & from) override {
+            FsCredentials creds{owner_};
+
+            if(! creds) {
+                if(System::logThrottled(failed_)) {
+                    spdlog::error("{}: {} failed, uid: {}, path: {}", __FUNCTION__, "setfsuid", owner_->uid, path);
+                }
+
+                return false;
+            }
+
+            int src = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+
+            // removed, the delete event
+            if(0 > src) {
+                return errno == ENOENT || errno == ELOOP;
+            }
+
+            struct stat st;
+
+            // the directory events
+            if(0 > fstat(src, & st) || ! S_ISREG(st.st_mode)) {
+                close(src);
+                return true;
+            }
+
+            auto name = std::filesystem::path{path}.filename().native();
+            auto now = unixTimeNs();
+
+            if(unique_) {
+                name = std::to_string(now).append(".").append(name);
+            }
+
+            // the readers see the whole file only
+            auto dst = dir_ / name;
+            auto tmp = dir_ / std::string(".").append(name).append(".").append(std::to_string(now));
+            bool res = false;
+
+            if(! copy_ && ! crossDevice_) {
+                // the same inode: the owner is not changed
+                res = 0 == link(path.c_str(), tmp.c_str());
+
+                if(! res && errno == EXDEV) {
+                    spdlog::warn("{}: spool dir on the other fs, the files are copied, dir: {}", __FUNCTION__, dir_.native());
+                    crossDevice_ = true;
+                }
+            }
+
+            // EPERM: fs.protected_hardlinks, the file of the other user is copied
+            if(! res && (copy_ || crossDevice_ || errno == EPERM)) {
+                res = copyFile(src, tmp.native(), st.st_mode);
+            }
+
+            close(src);
+
+            if(res && 0 > rename(tmp.c_str(), dst.c_str())) {
+                res = false;
+            }
+
+            if(! res) {
+                if(System::logThrottled(failed_)) {
+                    spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "spool", strerror(errno), errno, path);
+                }
+
+                unlink(tmp.c_str());
+            }
+
+            return res;
+        }
+
+        const char* type(void) const override {
+            return "spool";
+        }
+    };
+
+    /// the worker record to the named pipe, not blocked: the event is dropped without the reader or on the full pipe
+    class FifoAction : public Action {
+        const std::string file_;
+        const System::WorkerFormat format_;
+
+        int fd_ = -1;
+        std::string record_;
+        uint64_t failed_ = 0;
+
+      public:
+        FifoAction(const std::string & file, System::WorkerFormat format) : file_(file), format_(format) {
+            struct stat st;
+
+            if(0 > stat(file_.c_str(), & st) || ! S_ISFIFO(st.st_mode)) {
+                throw std::invalid_argument(std::string("fifo not found: ").append(file));
+            }
+        }
+
+        ~FifoAction() {
+            if(0 <= fd_) {
+                close(fd_);
+            }
+        }
+
+        bool run(const std::string & path, uint32_t mask, const std::string & from) override {
+            if(0 > fd_) {
+                // ENXIO: no reader
+                fd_ = ::open(file_.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+                if(0 > fd_) {
+                    if(System::logThrottled(failed_)) {
+                        spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, file_);
+                    }
+
+                    return false;
+                }
+            }
+
+            System::formatRecord(record_, format_, path, mask, from);
+
+            // up to PIPE_BUF: the record is not mixed with the other writers
+            auto res = write(fd_, record_.data(), record_.size());
+
+            if(res == static_cast<ssize_t>(record_.size())) {
+                return true;
+            }
+
+            if(System::logThrottled(failed_)) {
+                spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "write", (0 > res ? strerror(errno) : "partial"), (0 > res ? errno : 0), file_);
+            }
+
+            // EPIPE: the reader closed, the partial record: the stream is broken
+            if(0 <= res || errno != EAGAIN) {
+                close(fd_);
+                fd_ = -1;
+            }
+
+            return false;
+        }
+
+        const char* type(void) const override {
+            return "fifo";
+        }
+    };
+
+    /// the marker file mtime to now, created if missing, as the owner
+    class TouchAction : public Action {
+        const std::string file_;
+        System::CredentialsPtr owner_;
+        uint64_t failed_ = 0;
+
+      public:
+        TouchAction(const std::string & file, const System::CredentialsPtr & owner) : file_(file), owner_(owner) {}
+
+        bool run(const std::string & path, uint32_t mask, const std::string & from) override {
+            FsCredentials creds{owner_};
+
+            if(! creds) {
+                if(System::logThrottled(failed_)) {
+                    spdlog::error("{}: {} failed, uid: {}, path: {}", __FUNCTION__, "setfsuid", owner_->uid, file_);
+                }
+
+                return false;
+            }
+
+            if(0 == utimensat(AT_FDCWD, file_.c_str(), nullptr, 0)) {
+                return true;
+            }
+
+            if(errno == ENOENT) {
+                if(int fd = ::open(file_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644); 0 <= fd) {
+                    close(fd);
+                    return true;
+                }
+            }
+
+            if(System::logThrottled(failed_)) {
+                spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "touch", strerror(errno), errno, file_);
+            }
+
+            return false;
+        }
+
+        const char* type(void) const override {
+            return "touch";
+        }
+    };
+
+    /// dlopen once, shared by the jobs of the same library
+    class PluginLibrary : boost::noncopyable {
+        void* handle_ = nullptr;
+        const inotify_plugin* api_ = nullptr;
+
+      public:
+        explicit PluginLibrary(const std::string & library) {
+            handle_ = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+            if(! handle_) {
+                spdlog::error("{}: {} failed, error: {}", __FUNCTION__, "dlopen", dlerror());
+                throw std::invalid_argument(std::string("plugin not loaded: ").append(library));
+            }
+
+            auto entry = reinterpret_cast<inotify_plugin_entry_fn>(dlsym(handle_, "inotify_plugin_entry"));
+            api_ = entry ? entry() : nullptr;
+
+            if(! api_ || api_->abi != INOTIFY_PLUGIN_ABI || ! api_->create || ! api_->handle) {
+                dlclose(handle_);
+                throw std::invalid_argument(std::string("plugin abi mismatch: ").append(library));
+            }
+
+            spdlog::info("{}: plugin: {}, library: {}", __FUNCTION__, (api_->name ? api_->name : ""), library);
+        }
+
+        ~PluginLibrary() {
+            dlclose(handle_);
+        }
+
+        const inotify_plugin* api(void) const {
+            return api_;
+        }
+
+        static std::shared_ptr<PluginLibrary> load(const std::string & library) {
+            static std::mutex lock;
+            static std::unordered_map<std::string, std::weak_ptr<PluginLibrary>> libraries;
+
+            std::scoped_lock guard{ lock };
+
+            if(auto ptr = libraries[library].lock()) {
+                return ptr;
+            }
+
+            auto ptr = std::make_shared<PluginLibrary>(library);
+            libraries[library] = ptr;
+            return ptr;
+        }
+    };
+
+    class PluginAction : public Action {
+        std::shared_ptr<PluginLibrary> library_;
+        void* ctx_ = nullptr;
+
+      public:
+        PluginAction(const std::string & library, const std::string & config, const std::string & job, const System::CredentialsPtr & owner)
+            : library_(PluginLibrary::load(library)) {
+            inotify_plugin_init init{};
+            init.abi = INOTIFY_PLUGIN_ABI;
+            init.job = job.c_str();
+            init.config = config.c_str();
+            init.uid = owner ? static_cast<int64_t>(owner->uid) : -1;
+            init.gid = owner ? static_cast<int64_t>(owner->gid) : -1;
+
+            ctx_ = library_->api()->create(& init);
+
+            if(! ctx_) {
+                throw std::invalid_argument(std::string("plugin create failed: ").append(library));
+            }
+        }
+
+        ~PluginAction() {
+            if(library_->api()->destroy) {
+                library_->api()->destroy(ctx_);
+            }
+        }
+
+        bool run(const std::string & path, uint32_t mask, const std::string & from) override {
+            inotify_plugin_event event{};
+            event.mask = mask;
+            event.time_ns = unixTimeNs();
+            event.path = path.c_str();
+            event.from = from.size() ? from.c_str() : nullptr;
+
+            return 0 == library_->api()->handle(ctx_, & event);
+        }
+
+        const char* type(void) const override {
+            return "plugin";
+        }
+    };
+
+    std::string validateAction(const json::object & jo) {
+        auto type = jsonString(jo, "type", "");
+        const char* required = nullptr;
+
+        if(type == "append" || type == "fifo" || type == "touch") {
+            required = "file";
+        } else if(type == "spool") {
+            auto mode = jsonString(jo, "mode", "hardlink");
+
+            if(mode != "hardlink" && mode != "copy") {
+                throw std::invalid_argument(std::string("unknown spool mode: ").append(mode));
+            }
+
+            required = "dir";
+        } else if(type == "plugin") {
+            required = "library";
+        } else {
+            throw std::invalid_argument(std::string("unknown action: ").append(type));
+        }
+
+        if(jsonString(jo, required, "").empty()) {
+            throw std::invalid_argument(type + " " + required + " empty");
+        }
+
+        return type;
+    }
+
+    ActionPtr makeAction(const json::object & jo, const std::string & job, const System::CredentialsPtr & owner) {
+        auto type = validateAction(jo);
+
+        if(type == "append") {
+            return std::make_shared<AppendAction>(jsonString(jo, "file", ""), jsonString(jo, "format", "text") == "json", owner);
+        }
+
+        if(type == "spool") {
+            bool unique = jo.contains("unique") ? json::value_to<bool>(jo.at("unique")) : false;
+            return std::make_shared<SpoolAction>(jsonString(jo, "dir", ""), jsonString(jo, "mode", "hardlink") == "copy", unique, owner);
+        }
+
+        if(type == "fifo") {
+            auto format = jsonString(jo, "format", "json") == "binary" ? System::WorkerFormat::Binary : System::WorkerFormat::Json;
+            return std::make_shared<FifoAction>(jsonString(jo, "file", ""), format);
+        }
+
+        if(type == "touch") {
+            return std::make_shared<TouchAction>(jsonString(jo, "file", ""), owner);
+        }
+
+        auto config = jo.contains("config") ? json::serialize(jo.at("config")) : std::string{"{}"};
+        return std::make_shared<PluginAction>(jsonString(jo, "library", ""), config, job, owner);
+    }
+
+    struct ActionRunner::State {
+        asio::strand<asio::thread_pool::executor_type> strand;
+        ActionPtr action;
+        const size_t maxQueue;
+        JobMetricsPtr metrics;
+        ActionAckCb ackCb;
+        std::atomic<size_t> pending{0};
+
+        State(asio::thread_pool & pool, ActionPtr ptr, size_t max_queue, JobMetricsPtr jm, ActionAckCb && func)
+            : strand(asio::make_strand(pool.get_executor())), action(std::move(ptr)), maxQueue(max_queue), metrics(std::move(jm)), ackCb(std::move(func)) {}
+    };
+
+    ActionRunner::ActionRunner(asio::thread_pool & pool, ActionPtr action, size_t max_queue, JobMetricsPtr metrics, ActionAckCb && func)
+        : state_(std::make_shared<State>(pool, std::move(action), max_queue, std::move(metrics), std::move(func))) {
+    }
+
+    void ActionRunner::push(std::string_view path, uint32_t mask, uint64_t seq, std::string_view from) {
+        if(state_->maxQueue && state_->pending.load(std::memory_order_relaxed) >= state_->maxQueue) {
+            if(System::logThrottled(state_->metrics->actionsDropped)) {
+                spdlog::warn("{}: action queue full, job: {}, type: {}, limit: {}", __FUNCTION__, state_->metrics->job, state_->action->type(), state_->maxQueue);
+            }
+
+            return;
+        }
+
+        state_->pending.fetch_add(1, std::memory_order_relaxed);
+
+        // the state outlives the job: the action and the metrics are owned
+        asio::post(state_->strand, [state = state_, path = std::string(path), mask, seq, from = std::string(from)]() {
+            auto start = std::chrono::steady_clock::now();
+            bool success = state->action->run(path, mask, from);
+
+            state->pending.fetch_sub(1, std::memory_order_relaxed);
+            state->metrics->commandLatency.observe(elapsedUs(start));
+
+            if(! success) {
+                state->metrics->actionsFailed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            state->metrics->actions.fetch_add(1, std::memory_order_relaxed);
+
+            if(seq && state->ackCb) {
+                state->ackCb(seq);
+            }
+        });
+    }
+
+    size_t ActionRunner::countPending(void) const {
+        return state_->pending.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_ACTION_H_
+#define INOTIFY_ACTION_H_
+
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <string_view>
+
+#include "inotify_metrics.h"
+#include "inotify_process.h"
+
+namespace Inotify {
+    /// the in-process job action instead of the command: no fork and exec per event
+    class Action : boost::noncopyable {
+      public:
+        virtual ~Action() = default;
+
+        /// the events of one job are serialized, from: the old path of the rename
+        /// return false: failed, the event is not acknowledged
+        virtual bool run(const std::string & path, uint32_t mask, const std::string & from) = 0;
+        virtual const char* type(void) const = 0;
+    };
+
+    using ActionPtr = std::shared_ptr<Action>;
+
+    /// the config only, nothing is opened: return the type
+    /// throw: the invalid config
+    std::string validateAction(const boost::json::object &);
+
+    /// type: append, spool, fifo, touch or plugin; owner: the created files owner
+    /// throw: the invalid config, the file not opened or the plugin not loaded
+    ActionPtr makeAction(const boost::json::object &, const std::string & job, const System::CredentialsPtr & owner);
+
+    /// the action succeeded: the journal seq
+    using ActionAckCb = std::function<void(uint64_t seq)>;
+
+    /// the job action on the pool: the events of the job in order, the jobs in parallel,
+    /// the events over the queue limit are dropped
+    class ActionRunner : boost::noncopyable {
+        struct State;
+        std::shared_ptr<State> state_;
+
+      public:
+        /// max_queue: 0: unlimited
+        ActionRunner(boost::asio::thread_pool &, ActionPtr, size_t max_queue, JobMetricsPtr, ActionAckCb &&);
+
+        void push(std::string_view path, uint32_t mask, uint64_t seq, std::string_view from);
+        size_t countPending(void) const;
+    };
+}
+
+#endif // INOTIFY_ACTION_H_
@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <mutex>
+
+#include "inotify_batch.h"
+
+using namespace boost;
+
+namespace Inotify {
+    struct Batcher::State {
+        asio::steady_timer timer;
+        const size_t max;
+        const std::chrono::milliseconds window;
+        BatchFlushCb flushCb;
+
+        mutable std::mutex lock;
+        BatchEvents batch;
+        bool armed = false;
+        // the wait of the current batch, the completed stale wait is skipped
+        uint64_t generation = 0;
+
+        // the flush and the owner destructor
+        std::mutex flushLock;
+        bool stopped = false;
+
+        State(asio::io_context & ioc, size_t num, std::chrono::milliseconds ms, BatchFlushCb && func)
+            : timer(ioc), max(num), window(ms), flushCb(std::move(func)) {
+            batch.reserve(max);
+        }
+
+        void flush(BatchEvents && ready) {
+            std::scoped_lock guard{ flushLock };
+
+            if(! stopped) {
+                flushCb(std::move(ready));
+            }
+        }
+
+        void timerEvent(const system::error_code & ec, uint64_t gen) {
+            if(ec) {
+                return;
+            }
+
+            BatchEvents ready;
+
+            {
+                std::scoped_lock guard{ lock };
+
+                // flushed by the count, the next batch has own wait
+                if(gen != generation) {
+                    return;
+                }
+
+                armed = false;
+                ready.swap(batch);
+                batch.reserve(max);
+            }
+
+            if(ready.size()) {
+                flush(std::move(ready));
+            }
+        }
+    };
+
+    Batcher::Batcher(asio::io_context & ioc, size_t max, std::chrono::milliseconds window, BatchFlushCb && func)
+        : state_(std::make_shared<State>(ioc, max, window, std::move(func))) {
+    }
+
+    Batcher::~Batcher() {
+        {
+            std::scoped_lock guard{ state_->flushLock };
+            state_->stopped = true;
+        }
+
+        std::scoped_lock guard{ state_->lock };
+        state_->timer.cancel();
+    }
+
+    void Batcher::push(const std::filesystem::path & path, uint32_t mask, uint64_t seq, std::string_view from) {
+        BatchEvents ready;
+        auto & state = *state_;
+
+        {
+            std::scoped_lock guard{ state.lock };
+            state.batch.push_back(BatchEvent{path, mask, seq, std::string(from)});
+
+            if(state.batch.size() >= state.max) {
+                ready.swap(state.batch);
+                state.batch.reserve(state.max);
+
+                if(state.armed) {
+                    state.armed = false;
+                    state.generation++;
+                    state.timer.cancel();
+                }
+            } else if(! state.armed) {
+                state.armed = true;
+                // also cancels the stale wait
+                state.timer.expires_after(state.window);
+                // the handler does not keep the state: the owner gone, the timer is canceled
+                state.timer.async_wait([weak = std::weak_ptr<State>(state_), gen = ++state.generation](const system::error_code & ec) {
+                    if(auto ptr = weak.lock()) {
+                        ptr->timerEvent(ec, gen);
+                    }
+                });
+            }
+        }
+
+        if(ready.size()) {
+            state.flush(std::move(ready));
+        }
+    }
+
+    size_t Batcher::countPending(void) const {
+        std::scoped_lock guard{ state_->lock };
+        return state_->batch.size();
+    }
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_BATCH_H_
+#define INOTIFY_BATCH_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+
+namespace Inotify {
+    struct BatchEvent {
+        std::filesystem::path path;
+        uint32_t mask = 0;
+        // the journal record, 0: not journaled
+        uint64_t seq = 0;
+        // the rename: the old path
+        std::string from;
+    };
+
+    using BatchEvents = std::vector<BatchEvent>;
+    using BatchFlushCb = std::function<void(BatchEvents &&)>;
+
+    /// accumulate the events, flush by count or by time from the first event
+    class Batcher : boost::noncopyable {
+        struct State;
+        std::shared_ptr<State> state_;
+
+      public:
+        Batcher(boost::asio::io_context &, size_t max, std::chrono::milliseconds window, BatchFlushCb &&);
+        /// the pending events are dropped, the running flush is waited
+        ~Batcher();
+
+        void push(const std::filesystem::path &, uint32_t mask, uint64_t seq = 0, std::string_view from = {});
+        size_t countPending(void) const;
+    };
+}
+
+#endif // INOTIFY_BATCH_H_
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "inotify_metrics.h"
+#include "inotify_tools.h"
+#include "inotify_budget.h"
+
+namespace Inotify {
+    // the kernel limit is not readable
+    const size_t BUDGET_DEFAULT = 8192;
+
+    static size_t readProcValue(const char* path) {
+        std::ifstream ifs{path};
+        size_t value = 0;
+
+        if(! (ifs >> value)) {
+            return 0;
+        }
+
+        return value;
+    }
+
+    KernelLimits readKernelLimits(void) {
+        KernelLimits res;
+        res.maxUserWatches = readProcValue("/proc/sys/fs/inotify/max_user_watches");
+        res.maxUserInstances = readProcValue("/proc/sys/fs/inotify/max_user_instances");
+        res.maxQueuedEvents = readProcValue("/proc/sys/fs/inotify/max_queued_events");
+        return res;
+    }
+
+    void WatchBudget::setLimit(size_t budget) {
+        // the sysctl may be changed at runtime
+        auto kernel = readKernelLimits();
+        size_t limit = budget;
+
+        if(0 == limit) {
+            // the other processes of the user
+            limit = kernel.maxUserWatches ? kernel.maxUserWatches - kernel.maxUserWatches / 10 : BUDGET_DEFAULT;
+        } else if(kernel.maxUserWatches && limit > kernel.maxUserWatches) {
+            spdlog::warn("{}: budget over the kernel limit, budget: {}, max_user_watches: {}", __FUNCTION__, limit, kernel.maxUserWatches);
+            limit = kernel.maxUserWatches;
+        }
+
+        std::scoped_lock guard{ lock_ };
+        kernel_ = kernel;
+        limit_ = limit;
+
+        metrics().watchesLimit.store(limit_, std::memory_order_relaxed);
+        spdlog::info("{}: watches: {}, max_user_watches: {}, max_user_instances: {}", __FUNCTION__, limit_, kernel_.maxUserWatches, kernel_.maxUserInstances);
+    }
+
+    bool WatchBudget::reserve(int priority, size_t depth, uint64_t & victim) {
+        std::scoped_lock guard{ lock_ };
+        victim = 0;
+
+        if(used_ < limit_) {
+            used_++;
+            metrics().watchesUsed.store(used_, std::memory_order_relaxed);
+            return true;
+        }
+
+        // the lower priority, or the same priority and deeper
+        if(! order_.empty()) {
+            auto & [prio, depth_neg, id] = *order_.begin();
+
+            if(prio < priority || (prio == priority && -depth_neg > static_cast<long>(depth))) {
+                victim = id;
+                watches_.erase(id);
+                order_.erase(order_.begin());
+                evicted_++;
+                metrics().watchesEvicted.fetch_add(1, std::memory_order_relaxed);
+                // the slot is given to the caller
+                return true;
+            }
+        }
+
+        if(System::logThrottled(denied_)) {
+            spdlog::warn("{}: watch budget exhausted, limit: {}, denied: {}", __FUNCTION__, limit_, denied_);
+        }
+
+        return false;
+    }
+
+    void WatchBudget::track(uint64_t id, int priority, size_t depth) {
+        std::scoped_lock guard{ lock_ };
+        Key key{priority, -static_cast<long>(depth), id};
+
+        order_.insert(key);
+        watches_.emplace(id, key);
+    }
+
+    void WatchBudget::cancel(void) {
+        std::scoped_lock guard{ lock_ };
+
+        if(used_) {
+            used_--;
+            metrics().watchesUsed.store(used_, std::memory_order_relaxed);
+        }
+    }
+
+    void WatchBudget::release(uint64_t id) {
+        std::scoped_lock guard{ lock_ };
+
+        if(auto it = watches_.find(id); it != watches_.end()) {
+            order_.erase(it->second);
+            watches_.erase(it);
+
+            used_--;
+            metrics().watchesUsed.store(used_, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<uint64_t> WatchBudget::shrink(void) {
+        std::scoped_lock guard{ lock_ };
+        std::vector<uint64_t> victims;
+
+        while(used_ > limit_ && ! order_.empty()) {
+            auto id = std::get<2>(*order_.begin());
+            victims.push_back(id);
+            watches_.erase(id);
+            order_.erase(order_.begin());
+
+            used_--;
+            evicted_++;
+        }
+
+        if(victims.size()) {
+            metrics().watchesUsed.store(used_, std::memory_order_relaxed);
+            metrics().watchesEvicted.fetch_add(victims.size(), std::memory_order_relaxed);
+        }
+
+        return victims;
+    }
+
+    KernelLimits WatchBudget::kernel(void) const {
+        std::scoped_lock guard{ lock_ };
+        return kernel_;
+    }
+
+    void WatchBudget::status(void) const {
+        std::scoped_lock guard{ lock_ };
+        spdlog::info("{}: watches: {}/{}, max_user_watches: {}, max_user_instances: {}, evicted: {}, denied: {}", "WatchBudget",
+                        used_, limit_, kernel_.maxUserWatches, kernel_.maxUserInstances, evicted_, denied_);
+    }
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_BUDGET_H_
+#define INOTIFY_BUDGET_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <set>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+namespace Inotify {
+    /// /proc/sys/fs/inotify, 0: not readable
+    struct KernelLimits {
+        size_t maxUserWatches = 0;
+        size_t maxUserInstances = 0;
+        size_t maxQueuedEvents = 0;
+    };
+
+    KernelLimits readKernelLimits(void);
+
+    /// the inotify watches of the jobs, the kernel limit is per user and shared with the other processes
+    /// over the budget the watch goes to the more important dir: the lower priority and then the deeper watch is evicted,
+    /// the dirs without the watch are polled by the caller
+    class WatchBudget : boost::noncopyable {
+        // the eviction order: the lowest priority, the deepest first
+        using Key = std::tuple<int, long, uint64_t>;
+
+        mutable std::mutex lock_;
+        KernelLimits kernel_;
+        size_t limit_ = 0;
+        size_t used_ = 0;
+
+        std::set<Key> order_;
+        std::unordered_map<uint64_t, Key> watches_;
+
+        uint64_t denied_ = 0;
+        uint64_t evicted_ = 0;
+
+      public:
+        WatchBudget() = default;
+
+        /// budget: the watches limit, 0: the kernel max_user_watches less the 10% reserve
+        void setLimit(size_t budget);
+
+        /// true: the watch may be added, track() or cancel() follows
+        /// victim: the watch given away, the caller replaces it with the poll, 0: none
+        bool reserve(int priority, size_t depth, uint64_t & victim);
+        void track(uint64_t id, int priority, size_t depth);
+        void cancel(void);
+
+        /// the watch removed, the evicted and the unknown ids are ignored
+        void release(uint64_t id);
+
+        /// the limit lowered: the watches over it in the eviction order, the caller replaces them with the poll
+        std::vector<uint64_t> shrink(void);
+
+        KernelLimits kernel(void) const;
+        void status(void) const;
+    };
+}
+
+#endif // INOTIFY_BUDGET_H_
@@ -0,0 +1,162 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include <memory>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_control.h"
+
+using namespace boost;
+
+namespace Inotify {
+    // the request line limit
+    const size_t CONTROL_LINE_MAX = 1024 * 1024;
+
+    class ControlSession : public std::enable_shared_from_this<ControlSession> {
+        asio::local::stream_protocol::socket sock_;
+        asio::streambuf buf_{CONTROL_LINE_MAX};
+        std::string reply_;
+        ControlRequestCb requestCb_;
+
+      protected:
+        void readLine(void) {
+            asio::async_read_until(sock_, buf_, '\n', [self = shared_from_this()](const system::error_code & ec, size_t len) {
+                if(ec) {
+                    if(ec != asio::error::eof && ec != asio::error::operation_aborted) {
+                        spdlog::warn("{}: {} error, code: {}, message: {}", "ControlSession", "read", ec.value(), ec.message());
+                    }
+
+                    return;
+                }
+
+                std::string line(asio::buffers_begin(self->buf_.data()), asio::buffers_begin(self->buf_.data()) + len - 1);
+                self->buf_.consume(len);
+
+                if(line.size() && line.back() == '\r') {
+                    line.pop_back();
+                }
+
+                if(line.empty()) {
+                    self->readLine();
+                    return;
+                }
+
+                self->requestCb_(std::move(line), [self](std::string && reply) {
+                    self->writeReply(std::move(reply));
+                });
+            });
+        }
+
+        void writeReply(std::string && reply) {
+            // one request in flight: the socket is idle
+            reply_ = std::move(reply);
+            reply_.push_back('\n');
+
+            asio::async_write(sock_, asio::buffer(reply_), [self = shared_from_this()](const system::error_code & ec, size_t) {
+                if(! ec) {
+                    self->readLine();
+                }
+            });
+        }
+
+      public:
+        ControlSession(asio::local::stream_protocol::socket && sock, const ControlRequestCb & cb)
+            : sock_(std::move(sock)), requestCb_(cb) {}
+
+        void start(void) {
+            readLine();
+        }
+    };
+
+    /// the jobs run the commands as the service user: the peer is the service user or root, whatever the socket mode
+    static bool peerAllowed(int fd) {
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+
+        if(0 > getsockopt(fd, SOL_SOCKET, SO_PEERCRED, & cred, & len)) {
+            spdlog::warn("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "getsockopt", strerror(errno), errno);
+            return false;
+        }
+
+        if(cred.uid != 0 && cred.uid != geteuid()) {
+            spdlog::warn("{}: peer rejected, pid: {}, uid: {}", __FUNCTION__, cred.pid, cred.uid);
+            return false;
+        }
+
+        return true;
+    }
+
+    ControlServer::ControlServer(asio::io_context & ioc, const std::filesystem::path & path, unsigned mode, ControlRequestCb && func)
+        : acceptor_(ioc), path_(path), requestCb_(std::move(func)) {
+        std::error_code err;
+
+        // the stale socket of the previous run
+        if(std::filesystem::is_socket(path_, err)) {
+            std::filesystem::remove(path_, err);
+        }
+
+        system::error_code ec;
+        asio::local::stream_protocol::endpoint endpoint{path_.native()};
+
+        acceptor_.open(endpoint.protocol(), ec);
+
+        if(! ec) {
+            acceptor_.bind(endpoint, ec);
+        }
+
+        if(! ec) {
+            acceptor_.listen(asio::socket_base::max_listen_connections, ec);
+        }
+
+        if(ec) {
+            spdlog::error("{}: {} error, code: {}, message: {}, path: {}", __FUNCTION__, "bind", ec.value(), ec.message(), path_.native());
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        if(0 > chmod(path_.c_str(), mode)) {
+            spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "chmod", strerror(errno), errno, path_.native());
+        }
+
+        spdlog::info("{}: control socket: {}", __FUNCTION__, path_.native());
+        accept();
+    }
+
+    ControlServer::~ControlServer() {
+        system::error_code ec;
+        acceptor_.close(ec);
+
+        std::error_code err;
+        std::filesystem::remove(path_, err);
+    }
+
+    void ControlServer::accept(void) {
+        acceptor_.async_accept([this](const system::error_code & ec, asio::local::stream_protocol::socket sock) {
+            if(ec == asio::error::operation_aborted) {
+                return;
+            }
+
+            if(ec) {
+                spdlog::warn("{}: {} error, code: {}, message: {}", "ControlServer", "accept", ec.value(), ec.message());
+            } else if(peerAllowed(sock.native_handle())) {
+                std::make_shared<ControlSession>(std::move(sock), requestCb_)->start();
+            }
+
+            this->accept();
+        });
+    }
+}
@@ -0,0 +1,43 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_CONTROL_H_
+#define INOTIFY_CONTROL_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <string>
+#include <filesystem>
+#include <functional>
+
+namespace Inotify {
+    /// the reply line without the newline, called once from any thread
+    using ControlReplyCb = std::function<void(std::string &&)>;
+    using ControlRequestCb = std::function<void(std::string &&, ControlReplyCb &&)>;
+
+    /// the local control socket: the request and the reply are the lines,
+    /// the requests of one connection are handled in order, the next is read after the reply
+    class ControlServer : boost::noncopyable {
+        boost::asio::local::stream_protocol::acceptor acceptor_;
+        const std::filesystem::path path_;
+        ControlRequestCb requestCb_;
+
+      protected:
+        void accept(void);
+
+      public:
+        /// mode: the socket file permissions, throw: bind failed
+        ControlServer(boost::asio::io_context &, const std::filesystem::path &, unsigned mode, ControlRequestCb &&);
+        ~ControlServer();
+    };
+}
+
+#endif // INOTIFY_CONTROL_H_
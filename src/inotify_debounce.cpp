@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <spdlog/spdlog.h>
+
+#include "inotify_debounce.h"
+
+using namespace boost;
+
+namespace Inotify {
+    struct Debouncer::State : std::enable_shared_from_this<State> {
+        asio::steady_timer timer;
+        const std::chrono::milliseconds window;
+        DebounceFlushCb flushCb;
+
+        mutable std::mutex lock;
+        // the node addresses are stable on rehash
+        std::unordered_map<std::string, uint32_t> pending;
+        std::deque<std::pair<Clock::time_point, Pending*>> deadlines;
+        bool armed = false;
+
+        // the flush and the owner destructor
+        std::mutex flushLock;
+        bool stopped = false;
+
+        State(asio::io_context & ioc, std::chrono::milliseconds ms, DebounceFlushCb && func)
+            : timer(ioc), window(ms), flushCb(std::move(func)) {}
+
+        void armTimer(void) {
+            armed = true;
+            timer.expires_at(deadlines.front().first);
+            // the handler does not keep the state: the owner gone, the timer is canceled
+            timer.async_wait([weak = weak_from_this()](const system::error_code & ec) {
+                if(auto state = weak.lock()) {
+                    state->timerEvent(ec);
+                }
+            });
+        }
+
+        void timerEvent(const system::error_code & ec) {
+            if(ec) {
+                return;
+            }
+
+            std::list<std::pair<std::filesystem::path, uint32_t>> ready;
+
+            {
+                std::scoped_lock guard{ lock };
+                auto now = Clock::now();
+
+                while(! deadlines.empty() && deadlines.front().first <= now) {
+                    auto node = deadlines.front().second;
+                    deadlines.pop_front();
+
+                    ready.emplace_back(node->first, node->second);
+                    pending.erase(pending.find(node->first));
+                }
+
+                armed = false;
+
+                if(! deadlines.empty()) {
+                    armTimer();
+                }
+            }
+
+            std::scoped_lock guard{ flushLock };
+
+            if(stopped) {
+                return;
+            }
+
+            for(auto & [path, mask] : ready) {
+                flushCb(path, mask);
+            }
+        }
+    };
+
+    Debouncer::Debouncer(asio::io_context & ioc, std::chrono::milliseconds window, DebounceFlushCb && func)
+        : state_(std::make_shared<State>(ioc, window, std::move(func))) {
+    }
+
+    Debouncer::~Debouncer() {
+        {
+            std::scoped_lock guard{ state_->flushLock };
+            state_->stopped = true;
+        }
+
+        std::scoped_lock guard{ state_->lock };
+        state_->timer.cancel();
+    }
+
+    void Debouncer::push(const std::filesystem::path & path, uint32_t mask) {
+        std::scoped_lock guard{ state_->lock };
+        auto [it, inserted] = state_->pending.try_emplace(path.native(), 0);
+        it->second |= mask;
+
+        if(inserted) {
+            // window opened by the first event
+            state_->deadlines.emplace_back(Clock::now() + state_->window, & (*it));
+
+            if(! state_->armed) {
+                state_->armTimer();
+            }
+        }
+    }
+
+    size_t Debouncer::countPending(void) const {
+        std::scoped_lock guard{ state_->lock };
+        return state_->pending.size();
+    }
+}
@@ -0,0 +1,45 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_DEBOUNCE_H_
+#define INOTIFY_DEBOUNCE_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <memory>
+#include <chrono>
+#include <string>
+#include <filesystem>
+#include <functional>
+
+namespace Inotify {
+    using DebounceFlushCb = std::function<void(const std::filesystem::path &, uint32_t mask)>;
+
+    /// merge the events of the same path inside the window,
+    /// the window is the same for all paths, so the deadlines queue is always sorted and one timer is enough
+    class Debouncer : boost::noncopyable {
+        using Clock = std::chrono::steady_clock;
+        using Pending = std::pair<const std::string, uint32_t>;
+
+        struct State;
+        std::shared_ptr<State> state_;
+
+      public:
+        Debouncer(boost::asio::io_context &, std::chrono::milliseconds window, DebounceFlushCb &&);
+        /// the pending paths are dropped, the running flush is waited
+        ~Debouncer();
+
+        void push(const std::filesystem::path &, uint32_t mask);
+        size_t countPending(void) const;
+    };
+}
+
+#endif // INOTIFY_DEBOUNCE_H_
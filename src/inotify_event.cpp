@@ -0,0 +1,187 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+#include "inotify_event.h"
+
+#ifdef INOTIFY_WATCHER_ALLOC_COUNT
+namespace {
+    std::atomic<uint64_t> allocations{0};
+    thread_local int allocPaused = 0;
+
+    void* countedAlloc(size_t size) {
+        if(0 == allocPaused) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(auto ptr = std::malloc(size ? size : 1)) {
+            return ptr;
+        }
+
+        throw std::bad_alloc();
+    }
+}
+
+// the benchmark build: all heap allocations of the process
+void* operator new(size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAlloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+namespace Inotify {
+    /* Event */
+    void Event::assign(uint32_t mask0, std::string_view dir, std::string_view name) {
+        mask = mask0;
+        dirLen = dir.size();
+        nameLen = name.size();
+        time = std::chrono::steady_clock::now();
+
+        if(dir.size() + name.size() <= buf.size()) {
+            std::memcpy(buf.data(), dir.data(), dir.size());
+            std::memcpy(buf.data() + dir.size(), name.data(), name.size());
+            spill.clear();
+        } else {
+            spill.assign(dir).append(name);
+        }
+
+        from.clear();
+    }
+
+    /* EventPool */
+    EventPool::~EventPool() {
+        while(free_) {
+            auto next = free_->next;
+            delete free_;
+            free_ = next;
+        }
+    }
+
+    Event* EventPool::acquire(void) {
+        {
+            std::scoped_lock guard{ lock_ };
+
+            if(free_) {
+                auto ev = free_;
+                free_ = ev->next;
+                ev->next = nullptr;
+                count_--;
+                return ev;
+            }
+        }
+
+        // the pool grows up to the peak of the queued events
+        return new Event;
+    }
+
+    void EventPool::release(Event* ev) {
+        while(ev) {
+            auto next = ev->next;
+
+            {
+                std::scoped_lock guard{ lock_ };
+
+                if(count_ < maxFree_) {
+                    ev->next = free_;
+                    free_ = ev;
+                    count_++;
+                    ev = nullptr;
+                }
+            }
+
+            // over the limit: the burst records
+            delete ev;
+            ev = next;
+        }
+    }
+
+    EventPool & eventPool(void) {
+        static EventPool pool{4096};
+        return pool;
+    }
+
+    /* HandlerMemory */
+    HandlerMemory::HandlerMemory(size_t blocks, size_t block_size)
+        : blocks_(blocks), blockSize_((block_size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t) * sizeof(std::max_align_t)),
+            storage_(new std::max_align_t[blocks_ * blockSize_ / sizeof(std::max_align_t)]), used_(new std::atomic<bool>[blocks_]) {
+        for(size_t it = 0; it < blocks_; ++it) {
+            used_[it] = false;
+        }
+    }
+
+    void* HandlerMemory::allocate(size_t size) {
+        if(size <= blockSize_) {
+            for(size_t it = 0; it < blocks_; ++it) {
+                if(! used_[it].exchange(true, std::memory_order_acquire)) {
+                    return reinterpret_cast<unsigned char*>(storage_.get()) + it * blockSize_;
+                }
+            }
+        }
+
+        // the larger or the more handlers
+        return ::operator new(size);
+    }
+
+    void HandlerMemory::deallocate(void* ptr) {
+        auto base = reinterpret_cast<unsigned char*>(storage_.get());
+        auto addr = static_cast<unsigned char*>(ptr);
+
+        if(base <= addr && addr < base + blocks_ * blockSize_) {
+            used_[(addr - base) / blockSize_].store(false, std::memory_order_release);
+            return;
+        }
+
+        ::operator delete(ptr);
+    }
+
+#ifdef INOTIFY_WATCHER_ALLOC_COUNT
+    uint64_t heapAllocations(void) {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    AllocCountPause::AllocCountPause() {
+        allocPaused++;
+    }
+
+    AllocCountPause::~AllocCountPause() {
+        allocPaused--;
+    }
+#else
+    uint64_t heapAllocations(void) {
+        return 0;
+    }
+
+    AllocCountPause::AllocCountPause() {}
+
+    AllocCountPause::~AllocCountPause() {}
+#endif
+}
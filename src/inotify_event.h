@@ -0,0 +1,167 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_EVENT_H_
+#define INOTIFY_EVENT_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <string_view>
+
+namespace Inotify {
+    /// one kernel event: the pooled record, dispatched once for all mask bits
+    struct Event : boost::noncopyable {
+        // intrusive: the pool free list and the watch queue
+        Event* next = nullptr;
+        uint32_t mask = 0;
+        // 0: the watch path
+        uint16_t dirLen = 0;
+        uint16_t nameLen = 0;
+        // the kernel read, for the dispatch latency
+        std::chrono::steady_clock::time_point time;
+
+        // dir + name inline, the long fanotify dirs in spill, the capacity is kept by the pool
+        std::array<char, 384> buf;
+        std::string spill;
+        // the paired rename: the old path
+        std::string from;
+
+        void assign(uint32_t mask, std::string_view dir, std::string_view name);
+
+        const char* data(void) const {
+            return spill.empty() ? buf.data() : spill.data();
+        }
+
+        std::string_view dir(void) const {
+            return std::string_view(data(), dirLen);
+        }
+
+        std::string_view name(void) const {
+            return std::string_view(data() + dirLen, nameLen);
+        }
+    };
+
+    /// the free list of the records, the reader threads acquire, the watch strands release
+    class EventPool : boost::noncopyable {
+        std::mutex lock_;
+        Event* free_ = nullptr;
+        size_t count_ = 0;
+        const size_t maxFree_;
+
+      public:
+        explicit EventPool(size_t max_free) : maxFree_(max_free) {}
+        ~EventPool();
+
+        Event* acquire(void);
+        /// the chain by next
+        void release(Event*);
+    };
+
+    /// the process wide pool
+    EventPool & eventPool(void);
+
+    /// the fixed blocks for the handlers of one outstanding operation (post, async_write)
+    /// asio allocates the operation and the strand invoker from the handler allocator, the larger are on the heap
+    class HandlerMemory : boost::noncopyable {
+        const size_t blocks_;
+        const size_t blockSize_;
+
+        std::unique_ptr<std::max_align_t[]> storage_;
+        std::unique_ptr<std::atomic<bool>[]> used_;
+
+      public:
+        HandlerMemory(size_t blocks, size_t block_size);
+
+        void* allocate(size_t size);
+        void deallocate(void* ptr);
+    };
+
+    using HandlerMemoryPtr = std::shared_ptr<HandlerMemory>;
+
+    /// the allocator holds the memory: the blocks may be released after the owner of the handler
+    template<typename T>
+    class HandlerAllocator {
+        HandlerMemoryPtr memory_;
+
+        template<typename>
+        friend class HandlerAllocator;
+
+      public:
+        using value_type = T;
+
+        explicit HandlerAllocator(HandlerMemoryPtr memory) : memory_(std::move(memory)) {}
+
+        template<typename U>
+        HandlerAllocator(const HandlerAllocator<U> & other) noexcept : memory_(other.memory_) {}
+
+        T* allocate(size_t num) {
+            return static_cast<T*>(memory_->allocate(sizeof(T) * num));
+        }
+
+        void deallocate(T* ptr, size_t) {
+            memory_->deallocate(ptr);
+        }
+
+        template<typename U>
+        bool operator==(const HandlerAllocator<U> & other) const noexcept {
+            return memory_ == other.memory_;
+        }
+
+        template<typename U>
+        bool operator!=(const HandlerAllocator<U> & other) const noexcept {
+            return memory_ != other.memory_;
+        }
+    };
+
+    /// the handler with the associated allocator
+    template<typename Func>
+    class AllocHandler {
+        HandlerMemoryPtr memory_;
+        Func func_;
+
+      public:
+        using allocator_type = HandlerAllocator<Func>;
+
+        AllocHandler(const HandlerMemoryPtr & memory, Func && func) : memory_(memory), func_(std::move(func)) {}
+
+        allocator_type get_allocator(void) const noexcept {
+            return allocator_type(memory_);
+        }
+
+        template<typename... Args>
+        void operator()(Args &&... args) {
+            func_(std::forward<Args>(args)...);
+        }
+    };
+
+    template<typename Func>
+    AllocHandler<Func> makeAllocHandler(const HandlerMemoryPtr & memory, Func func) {
+        return AllocHandler<Func>(memory, std::move(func));
+    }
+
+    /// the heap allocations, counted with INOTIFY_WATCHER_ALLOC_COUNT only
+    uint64_t heapAllocations(void);
+
+    /// the allocations of the current thread are not counted: the metrics, the status
+    class AllocCountPause : boost::noncopyable {
+      public:
+        AllocCountPause();
+        ~AllocCountPause();
+    };
+}
+
+#endif // INOTIFY_EVENT_H_
@@ -0,0 +1,187 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <boost/algorithm/string/join.hpp>
+
+#include "inotify_tools.h"
+#include "inotify_executor.h"
+
+namespace System {
+    CommandExecutor::CommandExecutor(ProcessReaper & reaper, size_t max_parallel, size_t max_queue)
+        : reaper_(reaper), maxParallel_(max_parallel), maxQueue_(max_queue) {
+    }
+
+    void CommandExecutor::setLimits(size_t max_parallel, size_t max_queue) {
+        {
+            std::scoped_lock guard{ lock_ };
+            maxParallel_ = max_parallel;
+            maxQueue_ = max_queue;
+        }
+
+        schedule();
+    }
+
+    bool CommandExecutor::submit(const GroupPtr & group, Command && cmd, bool low) {
+        {
+            std::scoped_lock guard{ lock_ };
+
+            if(maxQueue_ && queued_ >= maxQueue_) {
+                if(System::logThrottled(dropped_)) {
+                    spdlog::warn("{}: queue full, size: {}, job: {}, dropped: {}", __FUNCTION__, queued_, group->name(), dropped_);
+                }
+
+                if(group->metrics_) {
+                    group->metrics_->dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                if(cmd.done) {
+                    cmd.done(false);
+                }
+
+                return false;
+            }
+
+            if(low) {
+                deferred_.emplace_back(group, Task{std::move(cmd), std::chrono::steady_clock::now()});
+            } else {
+                if(! group->ready_) {
+                    group->ready_ = true;
+                    ready_.push_back(group);
+                }
+
+                group->queue_.push_back(Task{std::move(cmd), std::chrono::steady_clock::now()});
+            }
+
+            queued_++;
+        }
+
+        schedule();
+        return true;
+    }
+
+    void CommandExecutor::schedule(void) {
+        std::list<std::pair<GroupPtr, Task>> tasks;
+
+        {
+            std::scoped_lock guard{ lock_ };
+            auto now = std::chrono::steady_clock::now();
+            bool progress = true;
+
+            auto start = [&](const GroupPtr & group, Task && task) {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(now - task.queued).count();
+                waitTotalMs_ += wait;
+                waitMaxMs_ = std::max(waitMaxMs_, static_cast<uint64_t>(wait));
+
+                tasks.emplace_back(group, std::move(task));
+                group->running_++;
+
+                queued_--;
+                running_++;
+                started_++;
+            };
+
+            while(progress && (! maxParallel_ || running_ < maxParallel_)) {
+                progress = false;
+
+                for(auto it = ready_.begin(); it != ready_.end() && (! maxParallel_ || running_ < maxParallel_);) {
+                    auto group = *it;
+
+                    if(group->queue_.empty()) {
+                        group->ready_ = false;
+                        it = ready_.erase(it);
+                        continue;
+                    }
+
+                    if(group->maxParallel_ && group->running_ >= group->maxParallel_) {
+                        ++it;
+                        continue;
+                    }
+
+                    start(group, std::move(group->queue_.front()));
+                    group->queue_.pop_front();
+
+                    progress = true;
+                    ++it;
+                }
+
+                if(progress || deferred_.empty()) {
+                    continue;
+                }
+
+                // one low priority task, then the ready groups again
+                if(auto it = std::find_if(deferred_.begin(), deferred_.end(), [](auto & pair) {
+                        return ! pair.first->maxParallel_ || pair.first->running_ < pair.first->maxParallel_; }); it != deferred_.end()) {
+                    start(it->first, std::move(it->second));
+                    deferred_.erase(it);
+                    progress = true;
+                }
+            }
+        }
+
+        // spawn without lock
+        for(auto & [group, task] : tasks) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - task.queued);
+            spdlog::info("{}: run cmd: {}, args: [{}], wait: {}ms", __FUNCTION__, task.cmd.cmd, boost::algorithm::join(task.cmd.args, ","), wait.count());
+
+            auto pid = reaper_.runCommand(task.cmd, [this, group = group, queued = task.queued, done = task.cmd.done](pid_t, int status, std::chrono::milliseconds) {
+                if(auto & metrics = group->metrics_) {
+                    // from the dispatch
+                    metrics->commandLatency.observe(Inotify::elapsedUs(queued));
+
+                    if(status) {
+                        metrics->failed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+
+                if(done) {
+                    done(0 == status);
+                }
+
+                this->commandExit(group);
+            });
+
+            if(auto & metrics = group->metrics_) {
+                (0 > pid ? metrics->failed : metrics->spawned).fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if(0 > pid) {
+                if(task.cmd.done) {
+                    task.cmd.done(false);
+                }
+
+                commandExit(group);
+            }
+        }
+    }
+
+    void CommandExecutor::commandExit(const GroupPtr & group) {
+        {
+            std::scoped_lock guard{ lock_ };
+            group->running_--;
+            running_--;
+        }
+
+        schedule();
+    }
+
+    void CommandExecutor::status(void) const {
+        std::scoped_lock guard{ lock_ };
+
+        spdlog::info("{}: running: {}/{}, queued: {}/{}, deferred: {}, started: {}, dropped: {}, wait avg: {}ms, wait max: {}ms", __FUNCTION__,
+                        running_, maxParallel_, queued_, maxQueue_, deferred_.size(), started_, dropped_, started_ ? waitTotalMs_ / started_ : 0, waitMaxMs_);
+
+        for(const auto & group : ready_) {
+            spdlog::info("{}: job: {}, running: {}/{}, queued: {}", __FUNCTION__,
+                        group->name(), group->running_, group->maxParallel_, group->queue_.size());
+        }
+    }
+}
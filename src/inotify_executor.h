@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_EXECUTOR_H_
+#define INOTIFY_EXECUTOR_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "inotify_metrics.h"
+#include "inotify_process.h"
+
+namespace System {
+    /// queue between the events and the process spawning, with global and per group limits
+    class CommandExecutor : boost::noncopyable {
+        struct Task {
+            Command cmd;
+            std::chrono::steady_clock::time_point queued;
+        };
+
+      public:
+        /// per job queue, shared by all watches of the job
+        class Group : boost::noncopyable {
+            const std::string name_;
+            const size_t maxParallel_;
+            const Inotify::JobMetricsPtr metrics_;
+
+            size_t running_ = 0;
+            std::deque<Task> queue_;
+            bool ready_ = false;
+
+            friend class CommandExecutor;
+
+          public:
+            Group(const std::string & name, size_t max_parallel, Inotify::JobMetricsPtr metrics = nullptr)
+                : name_(name), maxParallel_(max_parallel), metrics_(std::move(metrics)) {}
+
+            const std::string & name(void) const { return name_; }
+        };
+
+        using GroupPtr = std::shared_ptr<Group>;
+
+      private:
+        ProcessReaper & reaper_;
+
+        mutable std::mutex lock_;
+        // groups with the queued tasks, served round-robin
+        std::list<GroupPtr> ready_;
+        // the low priority tasks of all groups: only without the runnable ready tasks
+        std::deque<std::pair<GroupPtr, Task>> deferred_;
+
+        size_t maxParallel_ = 0;
+        size_t maxQueue_ = 0;
+
+        size_t running_ = 0;
+        size_t queued_ = 0;
+
+        uint64_t started_ = 0;
+        uint64_t dropped_ = 0;
+        uint64_t waitTotalMs_ = 0;
+        uint64_t waitMaxMs_ = 0;
+
+      protected:
+        void schedule(void);
+        void commandExit(const GroupPtr &);
+
+      public:
+        CommandExecutor(ProcessReaper &, size_t max_parallel, size_t max_queue);
+
+        void setLimits(size_t max_parallel, size_t max_queue);
+        /// low: the deferred task, the queue limit is shared
+        bool submit(const GroupPtr &, Command &&, bool low = false);
+
+        void status(void) const;
+    };
+}
+
+#endif // INOTIFY_EXECUTOR_H_
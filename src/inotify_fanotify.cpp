@@ -0,0 +1,280 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+#include "inotify_path.h"
+#include "inotify_fanotify.h"
+
+using namespace boost;
+
+namespace Inotify {
+    // the fanotify and inotify event bits are the same
+    const uint32_t FANOTIFY_EVENTS = IN_ACCESS|IN_MODIFY|IN_ATTRIB|IN_CLOSE|IN_OPEN|IN_MOVE|IN_CREATE|IN_DELETE;
+    const size_t FANOTIFY_HANDLES_MAX = 64 * 1024;
+
+    Fanotify::Fanotify(asio::io_context & ioc, const std::filesystem::path & root, uint32_t events, bool recursive, bool mount)
+        : sd_(ioc), strand_(asio::make_strand(ioc)), recursive_(recursive) {
+#ifdef FAN_REPORT_DFID_NAME
+        // the resolved handles are canonical
+        root_ = std::filesystem::weakly_canonical(root);
+
+        fd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE);
+
+        if(fd_ < 0) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "fanotify_init", strerror(errno), errno);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        sd_.assign(fd_);
+
+        // the directory moves: the handles cache invalidation
+        const uint64_t mask = (events & FANOTIFY_EVENTS) | FAN_MOVE | FAN_DELETE | FAN_ONDIR;
+
+        if(0 > fanotify_mark(fd_, FAN_MARK_ADD | (mount ? FAN_MARK_MOUNT : FAN_MARK_FILESYSTEM), mask, AT_FDCWD, root_.c_str())) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "fanotify_mark", strerror(errno), errno, root_.native());
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        // open_by_handle_at: any fd of the filesystem
+        mountfd_ = open(root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if(mountfd_ < 0) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, root_.native());
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        spdlog::info("{}: mark: {}, path: {}", __FUNCTION__, (mount ? "mount" : "filesystem"), root_.native());
+#else
+        spdlog::error("{}: {} failed, error: {}", __FUNCTION__, "fanotify_init", "FAN_REPORT_DFID_NAME not supported");
+        throw std::runtime_error(__FUNCTION__);
+#endif
+    }
+
+    Fanotify::~Fanotify() {
+        if(0 <= mountfd_) {
+            close(mountfd_);
+        }
+
+        // sd_ owns and closes fd_
+    }
+
+    void Fanotify::start(const std::shared_ptr<Path> & path) {
+        path_ = path;
+        asio::post(strand_, std::bind(& Fanotify::asyncRead, shared_from_this()));
+    }
+
+    void Fanotify::stop(void) {
+        asio::post(strand_, [self = shared_from_this()]() {
+            self->sd_.cancel();
+        });
+    }
+
+    void Fanotify::asyncRead(void) {
+        // the read handler keeps the group alive up to stop
+        sd_.async_read_some(asio::buffer(buf_),
+            asio::bind_executor(strand_, [self = shared_from_this()](const system::error_code & ec, size_t recv) {
+                self->readNotify(ec, recv);
+            }));
+    }
+
+    void Fanotify::readNotify(const system::error_code & ec, size_t recv) {
+        if(ec) {
+            if(ec.value() != system::errc::operation_canceled) {
+                spdlog::error("{}: {} error, code: {}, message: {}", __FUNCTION__, "read", ec.value(), ec.message());
+            }
+
+            return;
+        }
+
+        auto & stats = metrics();
+        stats.reads.fetch_add(1, std::memory_order_relaxed);
+        stats.readBytes.fetch_add(recv, std::memory_order_relaxed);
+        stats.readSize.observe(recv);
+
+        if(! parseEvents(buf_.data(), buf_.data() + recv)) {
+            return;
+        }
+
+        asyncRead();
+    }
+
+    bool Fanotify::inTree(const std::filesystem::path & dir) const {
+        auto & root = root_.native();
+        auto & str = dir.native();
+
+        if(str.size() < root.size() || 0 != str.compare(0, root.size(), root)) {
+            return false;
+        }
+
+        if(str.size() == root.size()) {
+            return true;
+        }
+
+        return recursive_ && (root.back() == '/' || str[root.size()] == '/');
+    }
+
+    bool Fanotify::prunedDir(const Filter & filter, const std::filesystem::path & dir) const {
+        std::string_view rel(dir.native());
+        rel.remove_prefix(std::min(root_.native().size(), rel.size()));
+
+        // the subdirs of the tree: the excluded subtree is skipped, the same as not watched
+        while(! rel.empty()) {
+            if(rel.front() == '/') {
+                rel.remove_prefix(1);
+                continue;
+            }
+
+            auto pos = rel.find('/');
+
+            if(filter.pruneDir(rel.substr(0, pos))) {
+                return true;
+            }
+
+            rel.remove_prefix(pos == std::string_view::npos ? rel.size() : pos);
+        }
+
+        return false;
+    }
+
+    bool Fanotify::resolveHandle(const std::string & key, file_handle* handle, std::filesystem::path & dir) {
+        if(auto it = handles_.find(key); it != handles_.end()) {
+            dir = it->second;
+            return true;
+        }
+
+        int fd = open_by_handle_at(mountfd_, handle, O_PATH | O_CLOEXEC);
+
+        if(0 > fd) {
+            // ESTALE: removed
+            if(errno != ESTALE) {
+                spdlog::warn("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "open_by_handle_at", strerror(errno), errno);
+            }
+
+            return false;
+        }
+
+        std::array<char, PATH_MAX> buf;
+        auto link = std::string("/proc/self/fd/").append(std::to_string(fd));
+        ssize_t len = readlink(link.c_str(), buf.data(), buf.size());
+        close(fd);
+
+        if(0 >= len) {
+            return false;
+        }
+
+        dir.assign(buf.data(), buf.data() + len);
+
+        if(handles_.size() >= FANOTIFY_HANDLES_MAX) {
+            handles_.clear();
+        }
+
+        handles_.emplace(key, dir);
+        return true;
+    }
+
+    bool Fanotify::parseEvents(const char* beg, const char* end) {
+        auto path = path_.lock();
+
+        if(! path) {
+            return false;
+        }
+
+        auto meta = reinterpret_cast<const struct fanotify_event_metadata*>(beg);
+        auto len = static_cast<size_t>(end - beg);
+
+        for(; FAN_EVENT_OK(meta, len); meta = FAN_EVENT_NEXT(meta, len)) {
+            if(meta->vers != FANOTIFY_METADATA_VERSION) {
+                spdlog::error("{}: read invalid, metadata version: {}", __FUNCTION__, meta->vers);
+                return false;
+            }
+
+            if(meta->mask & FAN_Q_OVERFLOW) {
+                overflows_++;
+                metrics().overflows.fetch_add(1, std::memory_order_relaxed);
+                spdlog::warn("{}: queue overflow, path: {}, count: {}", __FUNCTION__, root_.native(), overflows_);
+                path->dispatchEvent(IN_Q_OVERFLOW, nullptr);
+                continue;
+            }
+
+#ifdef FAN_REPORT_DFID_NAME
+            auto pos = reinterpret_cast<const char*>(meta) + meta->metadata_len;
+            auto last = reinterpret_cast<const char*>(meta) + meta->event_len;
+
+            const struct fanotify_event_info_fid* fid = nullptr;
+            bool named = false;
+
+            while(pos + sizeof(struct fanotify_event_info_header) <= last) {
+                auto hdr = reinterpret_cast<const struct fanotify_event_info_header*>(pos);
+
+                if(0 == hdr->len) {
+                    break;
+                }
+
+                if(hdr->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME || hdr->info_type == FAN_EVENT_INFO_TYPE_DFID) {
+                    fid = reinterpret_cast<const struct fanotify_event_info_fid*>(pos);
+                    named = hdr->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME;
+                    break;
+                }
+
+                pos += hdr->len;
+            }
+
+            if(! fid) {
+                continue;
+            }
+
+            auto handle = reinterpret_cast<file_handle*>(const_cast<unsigned char*>(fid->handle));
+            const char* name = named ? reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes) : nullptr;
+
+            // the event of the directory itself
+            if(name && name[0] == '.' && name[1] == 0) {
+                name = nullptr;
+            }
+
+            std::string key;
+            key.reserve(sizeof(fid->fsid) + sizeof(handle->handle_type) + handle->handle_bytes);
+            key.append(reinterpret_cast<const char*>(& fid->fsid), sizeof(fid->fsid));
+            key.append(reinterpret_cast<const char*>(& handle->handle_type), sizeof(handle->handle_type));
+            key.append(reinterpret_cast<const char*>(handle->f_handle), handle->handle_bytes);
+
+            std::filesystem::path dir;
+
+            if(! resolveHandle(key, handle, dir) || ! inTree(dir)) {
+                continue;
+            }
+
+            if(path->filter_ && prunedDir(*path->filter_, dir)) {
+                continue;
+            }
+
+            // the directory moved or deleted: the cached subtree paths are stale
+            if((meta->mask & FAN_ONDIR) && (meta->mask & (FAN_MOVE | FAN_DELETE))) {
+                handles_.clear();
+            }
+
+            // FAN_ONDIR is IN_ISDIR
+            path->dispatchEvent(static_cast<uint32_t>(meta->mask), dir, name);
+#endif
+        }
+
+        return true;
+    }
+}
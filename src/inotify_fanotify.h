@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_FANOTIFY_H_
+#define INOTIFY_FANOTIFY_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+
+struct file_handle;
+
+namespace Inotify {
+    class Path;
+    class Filter;
+
+    /// fanotify group with one filesystem (or mount) mark: the events of the whole tree without per directory watches
+    /// the directory file handles are resolved to the paths by open_by_handle_at, with cache
+    class Fanotify : boost::noncopyable, public std::enable_shared_from_this<Fanotify> {
+        int fd_ = -1;
+        int mountfd_ = -1;
+
+        boost::asio::posix::stream_descriptor sd_;
+        boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+
+        std::weak_ptr<Path> path_;
+        std::filesystem::path root_;
+        const bool recursive_;
+
+        // strand only: key: fsid, handle type, handle
+        std::unordered_map<std::string, std::filesystem::path> handles_;
+        uint64_t overflows_ = 0;
+
+        std::array<char, 64 * 1024> buf_;
+
+      protected:
+        void readNotify(const boost::system::error_code & ec, size_t recv);
+        void asyncRead(void);
+        bool parseEvents(const char* beg, const char* end);
+        bool resolveHandle(const std::string & key, file_handle*, std::filesystem::path &);
+        bool inTree(const std::filesystem::path &) const;
+        bool prunedDir(const Filter &, const std::filesystem::path &) const;
+
+      public:
+        /// events: the inotify mask, mount: FAN_MARK_MOUNT instead of FAN_MARK_FILESYSTEM
+        Fanotify(boost::asio::io_context &, const std::filesystem::path & root, uint32_t events, bool recursive, bool mount);
+        ~Fanotify();
+
+        /// the events are dispatched to the path
+        void start(const std::shared_ptr<Path> &);
+        void stop(void);
+    };
+}
+
+#endif // INOTIFY_FANOTIFY_H_
@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+
+#include "inotify_filter.h"
+
+namespace Inotify {
+    // [...] class at pos, return the length of the class or 0: not class
+    size_t globClass(std::string_view pattern, size_t pos, char ch, bool & matched) {
+        size_t it = pos + 1;
+        bool negate = false;
+
+        if(it < pattern.size() && (pattern[it] == '!' || pattern[it] == '^')) {
+            negate = true;
+            it++;
+        }
+
+        bool found = false;
+        bool first = true;
+
+        for(; it < pattern.size(); ++it) {
+            if(pattern[it] == ']' && ! first) {
+                matched = found != negate;
+                return it - pos + 1;
+            }
+
+            first = false;
+
+            if(it + 2 < pattern.size() && pattern[it + 1] == '-' && pattern[it + 2] != ']') {
+                if(pattern[it] <= ch && ch <= pattern[it + 2]) {
+                    found = true;
+                }
+
+                it += 2;
+            } else if(pattern[it] == ch) {
+                found = true;
+            }
+        }
+
+        // unclosed: literal '['
+        return 0;
+    }
+
+    bool globMatch(std::string_view pattern, std::string_view str) {
+        size_t pi = 0;
+        size_t si = 0;
+        // the last star: backtracking point
+        size_t star = std::string_view::npos;
+        size_t mark = 0;
+
+        while(si < str.size()) {
+            if(pi < pattern.size()) {
+                char pc = pattern[pi];
+
+                if(pc == '*') {
+                    star = pi++;
+                    mark = si;
+                    continue;
+                }
+
+                if(pc == '?') {
+                    pi++;
+                    si++;
+                    continue;
+                }
+
+                if(pc == '[') {
+                    bool matched = false;
+
+                    if(size_t len = globClass(pattern, pi, str[si], matched)) {
+                        if(matched) {
+                            pi += len;
+                            si++;
+                            continue;
+                        }
+                    } else if(str[si] == '[') {
+                        pi++;
+                        si++;
+                        continue;
+                    }
+                } else if(pc == str[si]) {
+                    pi++;
+                    si++;
+                    continue;
+                }
+            }
+
+            if(star == std::string_view::npos) {
+                return false;
+            }
+
+            pi = star + 1;
+            si = ++mark;
+        }
+
+        while(pi < pattern.size() && pattern[pi] == '*') {
+            pi++;
+        }
+
+        return pi == pattern.size();
+    }
+
+    NamePatterns::NamePatterns(const std::vector<std::string> & globs, const std::vector<std::string> & regexs) {
+        for(auto & glob : globs) {
+            auto wild = glob.find_first_of("*?[");
+
+            if(wild == std::string::npos) {
+                names_.push_back(glob);
+            } else if(wild == 0 && glob.size() > 1 && glob.find_first_of("*?[", 1) == std::string::npos) {
+                suffixes_.push_back(glob.substr(1));
+            } else {
+                globs_.push_back(glob);
+            }
+        }
+
+        std::sort(names_.begin(), names_.end());
+
+        if(! regexs.empty()) {
+            // one combined automaton
+            std::string combined;
+
+            for(auto & re : regexs) {
+                if(! combined.empty()) {
+                    combined.append("|");
+                }
+
+                combined.append("(?:").append(re).append(")");
+            }
+
+            regex_.emplace(combined, std::regex::ECMAScript | std::regex::optimize | std::regex::nosubs);
+        }
+    }
+
+    bool NamePatterns::empty(void) const {
+        return names_.empty() && suffixes_.empty() && globs_.empty() && ! regex_;
+    }
+
+    bool NamePatterns::match(std::string_view name) const {
+        if(std::binary_search(names_.begin(), names_.end(), name,
+            [](auto & a, auto & b){ return std::string_view(a) < std::string_view(b); })) {
+            return true;
+        }
+
+        for(auto & suffix : suffixes_) {
+            if(name.size() >= suffix.size() && 0 == name.compare(name.size() - suffix.size(), suffix.size(), suffix)) {
+                return true;
+            }
+        }
+
+        for(auto & glob : globs_) {
+            if(globMatch(glob, name)) {
+                return true;
+            }
+        }
+
+        return regex_ && std::regex_match(name.begin(), name.end(), *regex_);
+    }
+
+    Filter::Filter(const std::vector<std::string> & include, const std::vector<std::string> & exclude,
+                    const std::vector<std::string> & include_regex, const std::vector<std::string> & exclude_regex)
+        : include_(include, include_regex), exclude_(exclude, exclude_regex) {
+
+        for(auto list : { & include, & exclude, & include_regex, & exclude_regex }) {
+            for(auto & pattern : *list) {
+                source_.append(pattern).push_back('\0');
+            }
+
+            source_.push_back('\n');
+        }
+    }
+}
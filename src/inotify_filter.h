@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_FILTER_H_
+#define INOTIFY_FILTER_H_
+
+#include <regex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+#include <string_view>
+
+namespace Inotify {
+    /// glob: *, ? and [...] classes, without allocation
+    bool globMatch(std::string_view pattern, std::string_view str);
+
+    /// the name patterns compiled once: literal names, "*.ext" suffixes, globs and one combined regex
+    class NamePatterns {
+        // sorted
+        std::vector<std::string> names_;
+        std::vector<std::string> suffixes_;
+        std::vector<std::string> globs_;
+        std::optional<std::regex> regex_;
+
+      public:
+        NamePatterns() = default;
+        /// throw std::regex_error
+        NamePatterns(const std::vector<std::string> & globs, const std::vector<std::string> & regexs);
+
+        bool empty(void) const;
+        bool match(std::string_view name) const;
+    };
+
+    /// the job include/exclude filter for the entry names
+    class Filter {
+        NamePatterns include_;
+        NamePatterns exclude_;
+        // the patterns, for the jobs compare
+        std::string source_;
+
+      public:
+        Filter(const std::vector<std::string> & include, const std::vector<std::string> & exclude,
+                const std::vector<std::string> & include_regex, const std::vector<std::string> & exclude_regex);
+
+        /// the directories only excluded, the include patterns are for the files
+        bool matchName(std::string_view name, bool dir) const {
+            if(exclude_.match(name)) {
+                return false;
+            }
+
+            return dir || include_.empty() || include_.match(name);
+        }
+
+        /// the excluded subtree is not walked and not watched
+        bool pruneDir(std::string_view name) const {
+            return exclude_.match(name);
+        }
+
+        const std::string & source(void) const {
+            return source_;
+        }
+    };
+
+    using FilterPtr = std::shared_ptr<const Filter>;
+}
+
+#endif // INOTIFY_FILTER_H_
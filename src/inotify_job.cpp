@@ -0,0 +1,154 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+#include "inotify_job.h"
+#include "inotify_journal.h"
+#include "inotify_tools.h"
+
+using namespace boost;
+
+namespace Inotify {
+    uint32_t jsonArrayToEvents(const json::array & ar) {
+        uint32_t events = 0;
+
+        for(auto & val: ar) {
+            if(val.is_string()) {
+                events |= Inotify::nameToMask(val.get_string());
+            }
+        }
+
+        return events;
+    }
+
+    template<typename T>
+    T jsonValue(const json::object & jo, std::string_view key, const T & def) {
+        auto val = jo.if_contains(key);
+        return val ? json::value_to<T>(*val) : def;
+    }
+
+    JobDescPtr compileJob(const json::object & job_conf) {
+        if(! job_conf.contains("path") || ! job_conf.at("path").is_string()) {
+            spdlog::warn("{}: job skipped, tag not found: {}", __FUNCTION__, "path");
+            return nullptr;
+        }
+
+        auto desc = std::make_shared<JobDesc>();
+
+        try {
+            desc->path = std::filesystem::path{job_conf.at("path").get_string().c_str()};
+            desc->watch = desc->path;
+
+            if(auto val = job_conf.if_contains("inotify"); val && val->is_array()) {
+                desc->events = jsonArrayToEvents(val->as_array());
+            }
+
+            if(std::filesystem::is_regular_file(desc->path) && desc->events == EVENTS_BASE) {
+                // watch the parent dir: the file may be replaced
+                desc->watch = desc->path.parent_path();
+                desc->name = desc->path.filename().native();
+            }
+
+            auto include = jsonValue<std::vector<std::string>>(job_conf, "include", {});
+            auto exclude = jsonValue<std::vector<std::string>>(job_conf, "exclude", {});
+            auto include_regex = jsonValue<std::vector<std::string>>(job_conf, "include_regex", {});
+            auto exclude_regex = jsonValue<std::vector<std::string>>(job_conf, "exclude_regex", {});
+
+            if(include.size() || exclude.size() || include_regex.size() || exclude_regex.size()) {
+                desc->filter = std::make_shared<Filter>(include, exclude, include_regex, exclude_regex);
+            }
+
+            desc->command = jsonValue<std::string>(job_conf, "command", "");
+            desc->escaped = jsonValue<bool>(job_conf, "escaped", false);
+            desc->recursive = jsonValue<bool>(job_conf, "recursive", false);
+            desc->debug = jsonValue<bool>(job_conf, "debug", false);
+            desc->overflowRescan = jsonValue<bool>(job_conf, "overflow_rescan", false);
+            desc->maxDepth = jsonValue<size_t>(job_conf, "max_depth", 0);
+            desc->priority = jsonValue<int>(job_conf, "priority", 0);
+
+            desc->maxParallel = jsonValue<size_t>(job_conf, "max_parallel", 0);
+            desc->debounce = std::chrono::milliseconds(jsonValue<size_t>(job_conf, "debounce_ms", 0));
+
+            desc->batchMax = jsonValue<size_t>(job_conf, "batch_max", 0);
+            desc->batchWindow = std::chrono::milliseconds(jsonValue<size_t>(job_conf, "batch_ms", 100));
+            desc->batchStdin = jsonValue<std::string>(job_conf, "batch_mode", "args") == "stdin";
+            desc->batchDelimiter = jsonValue<std::string>(job_conf, "batch_delimiter", "newline") == "nul" ? '\0' : '\n';
+
+            if(auto mode = jsonValue<std::string>(job_conf, "mode", "exec"); mode == "worker") {
+                desc->worker = true;
+                desc->workerBinary = jsonValue<std::string>(job_conf, "worker_format", "json") == "binary";
+                desc->workerQueue = jsonValue<size_t>(job_conf, "worker_queue", 4096);
+            } else if(mode != "exec") {
+                throw std::invalid_argument(std::string("unknown mode: ").append(mode));
+            }
+
+            desc->rateLimit = jsonValue<double>(job_conf, "rate_limit", 0);
+            desc->rateBurst = jsonValue<size_t>(job_conf, "rate_burst", std::max(static_cast<size_t>(desc->rateLimit), size_t(1)));
+
+            if(auto policy = jsonValue<std::string>(job_conf, "rate_policy", "drop"); policy == "coalesce") {
+                desc->ratePolicy = RatePolicy::Coalesce;
+            } else if(policy == "defer") {
+                desc->ratePolicy = RatePolicy::Defer;
+            } else if(policy != "drop") {
+                throw std::invalid_argument(std::string("unknown rate policy: ").append(policy));
+            }
+
+            desc->skipUnchanged = jsonValue<bool>(job_conf, "skip_unchanged", false);
+            desc->unchangedCache = jsonValue<size_t>(job_conf, "skip_unchanged_cache", 65536);
+
+            desc->journal = jsonValue<bool>(job_conf, "journal", false);
+            desc->journalId = journalJobId(desc->path.native(), desc->command);
+
+            if(auto backend = jsonValue<std::string>(job_conf, "backend", "inotify"); backend == "fanotify") {
+                desc->fanotify = true;
+                desc->fanotifyMount = jsonValue<std::string>(job_conf, "fanotify_mark", "filesystem") == "mount";
+            } else if(backend != "inotify") {
+                throw std::invalid_argument(std::string("unknown backend: ").append(backend));
+            }
+
+            if(auto owner = jsonValue<std::string>(job_conf, "owner", ""); owner.size()) {
+                desc->owner = System::resolveOwner(owner);
+            }
+
+            if(auto val = job_conf.if_contains("action"); val && val->is_object()) {
+                if(desc->command.size() || desc->worker || 1 < desc->batchMax) {
+                    throw std::invalid_argument("action with command");
+                }
+
+                // validated only: the discarded configs do not open the files
+                desc->actionType = validateAction(val->as_object());
+                desc->action = val->as_object();
+                desc->actionQueue = jsonValue<size_t>(job_conf, "action_queue", 4096);
+                // the records owner: the path and the action
+                desc->journalId = journalJobId(desc->path.native(), json::serialize(*val));
+            }
+        } catch(const std::exception & err) {
+            spdlog::warn("{}: job skipped, path: {}, error: {}", __FUNCTION__, desc->path.native(), err.what());
+            return nullptr;
+        }
+
+        return desc;
+    }
+
+    bool sameWatches(const JobDesc & a, const JobDesc & b) {
+        auto filter = [](const JobDesc & desc) {
+            return desc.filter ? desc.filter->source() : std::string{};
+        };
+
+        return a.path == b.path && a.watch == b.watch && a.name == b.name && filter(a) == filter(b) &&
+                a.events == b.events && a.recursive == b.recursive &&
+                a.debug == b.debug && a.overflowRescan == b.overflowRescan &&
+                a.maxDepth == b.maxDepth && a.priority == b.priority &&
+                a.fanotify == b.fanotify && a.fanotifyMount == b.fanotifyMount;
+    }
+}
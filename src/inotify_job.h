@@ -0,0 +1,103 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_JOB_H_
+#define INOTIFY_JOB_H_
+
+#include <boost/json.hpp>
+
+#include <sys/inotify.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <filesystem>
+
+#include "inotify_action.h"
+#include "inotify_filter.h"
+#include "inotify_limiter.h"
+#include "inotify_process.h"
+
+namespace Inotify {
+    const uint32_t EVENTS_BASE = IN_CLOSE_WRITE|IN_DELETE_SELF;
+
+    /// job config compiled once on load, immutable and shared by all watches of the job
+    struct JobDesc {
+        // from config
+        std::filesystem::path path;
+        // watched directory, the parent for the file job
+        std::filesystem::path watch;
+        // file job: the events only for this name
+        std::string name;
+
+        uint32_t events = EVENTS_BASE;
+        // include/exclude, nullptr: all names
+        FilterPtr filter;
+        std::string command;
+        System::CredentialsPtr owner;
+        // the in-process action instead of the command, made by the runtime
+        std::string actionType;
+        boost::json::object action;
+        size_t actionQueue = 4096;
+
+        bool escaped = false;
+        bool recursive = false;
+        bool debug = false;
+        bool overflowRescan = false;
+
+        // the recursive job: the subdirs levels watched, 0: unlimited
+        size_t maxDepth = 0;
+        // the watch budget share: the higher keeps the watches, the lower is polled
+        int priority = 0;
+
+        // the fanotify mark instead of the inotify watches
+        bool fanotify = false;
+        bool fanotifyMount = false;
+
+        size_t maxParallel = 0;
+        std::chrono::milliseconds debounce{0};
+
+        size_t batchMax = 0;
+        std::chrono::milliseconds batchWindow{100};
+        bool batchStdin = false;
+        char batchDelimiter = '\n';
+
+        // the persistent worker instead of the command per event
+        bool worker = false;
+        bool workerBinary = false;
+        size_t workerQueue = 4096;
+
+        // the token bucket, 0: unlimited
+        double rateLimit = 0;
+        size_t rateBurst = 0;
+        RatePolicy ratePolicy = RatePolicy::Drop;
+
+        // the IN_CLOSE_WRITE with the same content is dropped, the cache entries
+        bool skipUnchanged = false;
+        size_t unchangedCache = 65536;
+
+        // the dispatched events are recorded, replayed after the restart
+        bool journal = false;
+        // the records owner: the path and the command
+        uint64_t journalId = 0;
+    };
+
+    using JobDescPtr = std::shared_ptr<const JobDesc>;
+
+    uint32_t jsonArrayToEvents(const boost::json::array &);
+
+    /// return nullptr for invalid job
+    JobDescPtr compileJob(const boost::json::object &);
+
+    /// the jobs place the same watches, the runtime settings may differ
+    bool sameWatches(const JobDesc &, const JobDesc &);
+}
+
+#endif // INOTIFY_JOB_H_
@@ -0,0 +1,386 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+#include "inotify_metrics.h"
+#include "inotify_tools.h"
+#include "inotify_journal.h"
+
+namespace Inotify {
+    const char JOURNAL_MAGIC[8] = { 'I', 'N', 'W', 'J', 'R', 'N', 'L', '1' };
+    // the header page, the records after
+    const size_t JOURNAL_DATA = 4096;
+    const size_t JOURNAL_MIN_SIZE = 1024 * 1024;
+
+    const uint32_t RECORD_ACKED = 0x01;
+    // the skipped ring end
+    const uint32_t RECORD_PAD = 0x02;
+
+    struct JournalHeader {
+        char magic[8];
+        uint64_t capacity;
+        // the oldest unacknowledged record
+        uint64_t headOffset;
+        uint64_t headSeq;
+    };
+
+    struct RecordHeader {
+        uint32_t size;
+        uint32_t mask;
+        // written last: the torn record is not valid
+        uint64_t seq;
+        uint64_t job;
+        uint32_t flags;
+        uint32_t len;
+    };
+
+    static_assert(sizeof(RecordHeader) == 32, "journal record header size");
+
+    inline size_t recordSize(size_t len) {
+        return (sizeof(RecordHeader) + len + 7) & ~size_t(7);
+    }
+
+    uint64_t journalJobId(std::string_view path, std::string_view command) {
+        uint64_t hash = 14695981039346656037ull;
+
+        auto update = [&hash](std::string_view str) {
+            for(auto ch : str) {
+                hash ^= static_cast<uint8_t>(ch);
+                hash *= 1099511628211ull;
+            }
+        };
+
+        update(path);
+        update(std::string_view("\0", 1));
+        update(command);
+
+        return hash;
+    }
+
+    Journal::Journal(const std::filesystem::path & file, size_t size, std::chrono::milliseconds sync) : sync_(sync) {
+        size_ = std::max(size, JOURNAL_MIN_SIZE) & ~(JOURNAL_DATA - 1);
+        capacity_ = size_ - JOURNAL_DATA;
+
+        fd_ = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+        if(0 > fd_) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, file.native());
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        struct stat st;
+        bool reinit = 0 > fstat(fd_, & st) || static_cast<size_t>(st.st_size) != size_;
+
+        if(reinit && 0 > ftruncate(fd_, size_)) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "ftruncate", strerror(errno), errno, file.native());
+            close(fd_);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        auto ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+        if(ptr == MAP_FAILED) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "mmap", strerror(errno), errno, file.native());
+            close(fd_);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        map_ = static_cast<uint8_t*>(ptr);
+        auto header = reinterpret_cast<JournalHeader*>(map_);
+
+        if(reinit || 0 != memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) || header->capacity != capacity_) {
+            spdlog::info("{}: new journal, path: {}, size: {}", __FUNCTION__, file.native(), size_);
+            initHeader();
+        } else {
+            recover();
+            spdlog::info("{}: journal opened, path: {}, size: {}, unacknowledged: {}", __FUNCTION__, file.native(), size_, recovered_.size());
+        }
+
+        if(sync_.count()) {
+            syncer_ = std::thread(& Journal::syncLoop, this);
+        }
+    }
+
+    Journal::~Journal() {
+        {
+            std::scoped_lock guard{ lock_ };
+            shutdown_ = true;
+        }
+
+        cond_.notify_all();
+
+        if(syncer_.joinable()) {
+            syncer_.join();
+        }
+
+        msync(map_, size_, MS_SYNC);
+        munmap(map_, size_);
+        close(fd_);
+    }
+
+    void Journal::initHeader(void) {
+        auto header = reinterpret_cast<JournalHeader*>(map_);
+
+        memset(map_, 0, JOURNAL_DATA);
+        memcpy(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header->capacity = capacity_;
+        header->headOffset = 0;
+        header->headSeq = 1;
+
+        headSeq_ = nextSeq_ = 1;
+        tail_ = 0;
+        used_ = 0;
+    }
+
+    void Journal::recover(void) {
+        auto header = reinterpret_cast<JournalHeader*>(map_);
+        auto data = map_ + JOURNAL_DATA;
+
+        auto valid = [&](uint64_t off, uint64_t seq) {
+            if(off + sizeof(RecordHeader) > capacity_) {
+                return false;
+            }
+
+            auto rec = reinterpret_cast<const RecordHeader*>(data + off);
+
+            return rec->seq == seq && 0 == (rec->flags & RECORD_PAD) && sizeof(RecordHeader) <= rec->size &&
+                    0 == (rec->size & 7) && off + rec->size <= capacity_ && rec->len <= rec->size - sizeof(RecordHeader);
+        };
+
+        uint64_t off = header->headOffset < capacity_ ? header->headOffset : 0;
+        uint64_t seq = header->headSeq ? header->headSeq : 1;
+
+        // the head store may be torn: the later record at the head offset is accepted
+        if(off + sizeof(RecordHeader) <= capacity_) {
+            if(auto rec = reinterpret_cast<const RecordHeader*>(data + off); rec->seq > seq && valid(off, rec->seq)) {
+                seq = rec->seq;
+            }
+        }
+
+        headSeq_ = nextSeq_ = seq;
+        tail_ = off;
+        used_ = 0;
+
+        for(bool first = true;; first = false) {
+            uint64_t next = off;
+            uint64_t skip = 0;
+
+            // the ring end: too short for the header, or the pad record
+            if(capacity_ - next < sizeof(RecordHeader)) {
+                skip = capacity_ - next;
+                next = 0;
+            } else if(auto rec = reinterpret_cast<const RecordHeader*>(data + next);
+                    (rec->flags & RECORD_PAD) && rec->size == capacity_ - next) {
+                skip = rec->size;
+                next = 0;
+            }
+
+            if(! valid(next, nextSeq_)) {
+                break;
+            }
+
+            auto rec = reinterpret_cast<const RecordHeader*>(data + next);
+            uint32_t span = (first ? 0 : skip) + rec->size;
+
+            if(used_ + span > capacity_) {
+                break;
+            }
+
+            bool acked = rec->flags & RECORD_ACKED;
+            slots_.push_back(Slot{next, span, acked});
+            used_ += span;
+
+            if(! acked) {
+                std::string_view str(reinterpret_cast<const char*>(rec + 1), rec->len);
+                auto nul = str.find('\0');
+
+                // the rename: path NUL from
+                recovered_.push_back(JournalEntry{rec->seq, rec->job, rec->mask, std::string(str.substr(0, nul)),
+                        nul != std::string_view::npos ? std::string(str.substr(nul + 1)) : std::string()});
+            }
+
+            off = next + rec->size;
+
+            if(off == capacity_) {
+                off = 0;
+            }
+
+            tail_ = off;
+            nextSeq_++;
+        }
+
+        popAcked();
+    }
+
+    void Journal::storeHead(void) {
+        auto header = reinterpret_cast<JournalHeader*>(map_);
+        header->headOffset = slots_.empty() ? tail_ : slots_.front().offset;
+        header->headSeq = headSeq_;
+    }
+
+    void Journal::popAcked(void) {
+        while(! slots_.empty() && slots_.front().acked) {
+            used_ -= slots_.front().span;
+            slots_.pop_front();
+            headSeq_++;
+        }
+
+        storeHead();
+    }
+
+    void Journal::evictOldest(void) {
+        auto & slot = slots_.front();
+
+        if(! slot.acked) {
+            metrics().journalLost.fetch_add(1, std::memory_order_relaxed);
+
+            if(System::logThrottled(lost_)) {
+                spdlog::warn("{}: journal full, unacknowledged record overwritten, seq: {}, lost: {}", __FUNCTION__, headSeq_, lost_);
+            }
+        }
+
+        used_ -= slot.span;
+        slots_.pop_front();
+        headSeq_++;
+    }
+
+    uint64_t Journal::append(uint64_t job, std::string_view path, uint32_t mask, std::string_view from) {
+        const size_t len = path.size() + (from.size() ? 1 + from.size() : 0);
+        const size_t size = recordSize(len);
+
+        if(size > capacity_ / 2) {
+            return 0;
+        }
+
+        std::scoped_lock guard{ lock_ };
+
+        // the record is not split: the ring end is skipped
+        const uint64_t skip = capacity_ - tail_ < size ? capacity_ - tail_ : 0;
+
+        if(used_ + skip + size > capacity_) {
+            while(! slots_.empty() && used_ + skip + size > capacity_) {
+                evictOldest();
+            }
+
+            storeHead();
+        }
+
+        auto data = map_ + JOURNAL_DATA;
+
+        if(skip) {
+            if(skip >= sizeof(RecordHeader)) {
+                auto pad = reinterpret_cast<RecordHeader*>(data + tail_);
+                *pad = RecordHeader{static_cast<uint32_t>(skip), 0, 0, 0, RECORD_PAD, 0};
+            }
+
+            tail_ = 0;
+        }
+
+        const uint64_t seq = nextSeq_++;
+        auto rec = reinterpret_cast<RecordHeader*>(data + tail_);
+
+        rec->size = size;
+        rec->mask = mask;
+        rec->job = job;
+        rec->flags = 0;
+        rec->len = len;
+        memcpy(rec + 1, path.data(), path.size());
+
+        if(from.size()) {
+            auto ptr = reinterpret_cast<char*>(rec + 1) + path.size();
+            *ptr = 0;
+            memcpy(ptr + 1, from.data(), from.size());
+        }
+        __atomic_store_n(& rec->seq, seq, __ATOMIC_RELEASE);
+
+        if(slots_.empty()) {
+            headSeq_ = seq;
+        }
+
+        slots_.push_back(Slot{tail_, static_cast<uint32_t>(skip + size), false});
+        used_ += skip + size;
+        tail_ += size;
+
+        if(tail_ == capacity_) {
+            tail_ = 0;
+        }
+
+        if(slots_.size() == 1) {
+            storeHead();
+        }
+
+        appended_++;
+        metrics().journalAppended.fetch_add(1, std::memory_order_relaxed);
+
+        return seq;
+    }
+
+    void Journal::ack(uint64_t seq) {
+        std::scoped_lock guard{ lock_ };
+
+        if(seq < headSeq_ || seq >= nextSeq_) {
+            return;
+        }
+
+        auto & slot = slots_[seq - headSeq_];
+
+        if(slot.acked) {
+            return;
+        }
+
+        slot.acked = true;
+        reinterpret_cast<RecordHeader*>(map_ + JOURNAL_DATA + slot.offset)->flags |= RECORD_ACKED;
+
+        acked_++;
+        metrics().journalAcked.fetch_add(1, std::memory_order_relaxed);
+
+        if(seq == headSeq_) {
+            popAcked();
+        }
+    }
+
+    std::vector<JournalEntry> Journal::takeRecovered(void) {
+        std::scoped_lock guard{ lock_ };
+        return std::move(recovered_);
+    }
+
+    void Journal::syncLoop(void) {
+        std::unique_lock guard{ lock_ };
+
+        while(! shutdown_) {
+            cond_.wait_for(guard, sync_);
+
+            // the group commit, without lock: the appends continue
+            guard.unlock();
+
+            if(0 > msync(map_, size_, MS_SYNC)) {
+                spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "msync", strerror(errno), errno);
+            }
+
+            guard.lock();
+        }
+    }
+
+    void Journal::status(void) const {
+        std::scoped_lock guard{ lock_ };
+        spdlog::info("{}: records: {}, used: {}/{}, appended: {}, acked: {}, lost: {}, next seq: {}", "Journal",
+                     slots_.size(), used_, capacity_, appended_, acked_, lost_, nextSeq_);
+    }
+}
@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_JOURNAL_H_
+#define INOTIFY_JOURNAL_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <filesystem>
+#include <string_view>
+#include <condition_variable>
+
+namespace Inotify {
+    /// the unacknowledged record of the previous run
+    struct JournalEntry {
+        uint64_t seq = 0;
+        uint64_t job = 0;
+        uint32_t mask = 0;
+        std::string path;
+        // the rename: the old path
+        std::string from;
+    };
+
+    /// the append-only ring of the dispatched events in the mmap file
+    /// records: u32 size, u32 mask, u64 seq, u64 job, u32 flags, u32 path size, path [NUL from]; 8 bytes aligned
+    /// the acknowledged records are flagged, the head follows the oldest unacknowledged one
+    /// the page cache keeps the records on the process crash, msync every sync interval for the power loss
+    class Journal : boost::noncopyable {
+        struct Slot {
+            // the record offset, the span includes the skipped ring end
+            uint64_t offset;
+            uint32_t span;
+            bool acked;
+        };
+
+        int fd_ = -1;
+        uint8_t* map_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+
+        mutable std::mutex lock_;
+        // the records from the head, indexed by seq - headSeq_
+        std::deque<Slot> slots_;
+        uint64_t headSeq_ = 1;
+        uint64_t nextSeq_ = 1;
+        uint64_t tail_ = 0;
+        uint64_t used_ = 0;
+
+        std::vector<JournalEntry> recovered_;
+
+        uint64_t appended_ = 0;
+        uint64_t acked_ = 0;
+        uint64_t lost_ = 0;
+
+        // the group commit
+        std::chrono::milliseconds sync_;
+        std::thread syncer_;
+        std::condition_variable cond_;
+        bool shutdown_ = false;
+
+        void initHeader(void);
+        void recover(void);
+        void popAcked(void);
+        void evictOldest(void);
+        void storeHead(void);
+        void syncLoop(void);
+
+      public:
+        /// size: the file size, sync: the msync interval, 0: the page cache only
+        Journal(const std::filesystem::path &, size_t size, std::chrono::milliseconds sync);
+        ~Journal();
+
+        /// return the sequence number, the oldest records are overwritten on the full ring
+        uint64_t append(uint64_t job, std::string_view path, uint32_t mask, std::string_view from = {});
+        /// the command is done: the record is not replayed
+        void ack(uint64_t seq);
+
+        /// the unacknowledged records at the open, moved out once
+        std::vector<JournalEntry> takeRecovered(void);
+
+        void status(void) const;
+    };
+
+    using JournalPtr = std::shared_ptr<Journal>;
+
+    /// the stable job id for the journal records: FNV-1a
+    uint64_t journalJobId(std::string_view path, std::string_view command);
+}
+
+#endif // INOTIFY_JOURNAL_H_
@@ -0,0 +1,212 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+#include "inotify_tools.h"
+#include "inotify_limiter.h"
+
+using namespace boost;
+
+namespace Inotify {
+    // the coalesced paths, the events of the new paths over it are dropped
+    const size_t LIMITER_PENDING_MAX = 65536;
+
+    struct RateLimiter::State : std::enable_shared_from_this<State> {
+        using Clock = std::chrono::steady_clock;
+
+        struct Held {
+            uint32_t mask;
+            std::string from;
+        };
+
+        using Pending = std::pair<const std::string, Held>;
+
+        asio::steady_timer timer;
+        const double rate;
+        const double burst;
+        const RatePolicy policy;
+        const JobMetricsPtr metrics;
+        RateFlushCb flushCb;
+
+        mutable std::mutex lock;
+        double tokens;
+        Clock::time_point refilled;
+
+        // coalesce, the node addresses are stable on rehash
+        std::unordered_map<std::string, Held> pending;
+        std::deque<Pending*> order;
+        bool armed = false;
+
+        uint64_t shed = 0;
+        uint64_t coalesced = 0;
+        uint64_t deferred = 0;
+
+        // the flush and the owner destructor
+        std::mutex flushLock;
+        bool stopped = false;
+
+        State(asio::io_context & ioc, double num, size_t size, RatePolicy rp, JobMetricsPtr jm, RateFlushCb && func)
+            : timer(ioc), rate(num), burst(std::max(size, size_t(1))), policy(rp), metrics(std::move(jm)), flushCb(std::move(func)),
+                tokens(burst), refilled(Clock::now()) {}
+
+        void refill(Clock::time_point now) {
+            auto elapsed = std::chrono::duration<double>(now - refilled).count();
+            tokens = std::min(burst, tokens + elapsed * rate);
+            refilled = now;
+        }
+
+        void armTimer(void) {
+            armed = true;
+            // the next token
+            auto wait = std::chrono::duration<double>(std::max(0.0, 1.0 - tokens) / rate);
+            timer.expires_after(std::chrono::duration_cast<Clock::duration>(wait));
+            // the handler does not keep the state: the owner gone, the timer is canceled
+            timer.async_wait([weak = weak_from_this()](const system::error_code & ec) {
+                if(auto state = weak.lock()) {
+                    state->timerEvent(ec);
+                }
+            });
+        }
+
+        void timerEvent(const system::error_code & ec) {
+            if(ec) {
+                return;
+            }
+
+            std::list<std::pair<std::string, Held>> ready;
+
+            {
+                std::scoped_lock guard{ lock };
+                refill(Clock::now());
+
+                while(! order.empty() && 1.0 <= tokens) {
+                    auto node = order.front();
+                    order.pop_front();
+
+                    ready.emplace_back(node->first, std::move(node->second));
+                    pending.erase(pending.find(node->first));
+                    tokens -= 1.0;
+                }
+
+                armed = false;
+
+                if(! order.empty()) {
+                    armTimer();
+                }
+            }
+
+            std::scoped_lock guard{ flushLock };
+
+            if(stopped) {
+                return;
+            }
+
+            for(auto & [path, held] : ready) {
+                flushCb(path, held.mask, held.from);
+            }
+        }
+    };
+
+    RateLimiter::RateLimiter(asio::io_context & ioc, double rate, size_t burst, RatePolicy policy, JobMetricsPtr metrics, RateFlushCb && func)
+        : state_(std::make_shared<State>(ioc, rate, burst, policy, std::move(metrics), std::move(func))) {
+    }
+
+    RateLimiter::~RateLimiter() {
+        {
+            std::scoped_lock guard{ state_->flushLock };
+            state_->stopped = true;
+        }
+
+        std::scoped_lock guard{ state_->lock };
+        state_->timer.cancel();
+    }
+
+    RateVerdict RateLimiter::admit(std::string_view path, uint32_t mask, std::string_view from) {
+        auto & state = *state_;
+        std::scoped_lock guard{ state.lock };
+
+        if(state.policy == RatePolicy::Coalesce && ! state.pending.empty()) {
+            // the held path: replaced by the latest event
+            if(auto it = state.pending.find(std::string(path)); it != state.pending.end()) {
+                it->second.mask = mask;
+                it->second.from.assign(from);
+                state.coalesced++;
+
+                if(state.metrics) {
+                    state.metrics->coalesced.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                return RateVerdict::Shed;
+            }
+        }
+
+        state.refill(State::Clock::now());
+
+        if(1.0 <= state.tokens) {
+            state.tokens -= 1.0;
+            return RateVerdict::Pass;
+        }
+
+        switch(state.policy) {
+            case RatePolicy::Defer:
+                state.deferred++;
+
+                if(state.metrics) {
+                    state.metrics->deferred.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                return RateVerdict::Deferred;
+
+            case RatePolicy::Coalesce:
+                if(state.pending.size() < LIMITER_PENDING_MAX) {
+                    auto [it, inserted] = state.pending.try_emplace(std::string(path), State::Held{mask, std::string(from)});
+                    state.order.push_back(& (*it));
+                    state.coalesced++;
+
+                    if(state.metrics) {
+                        state.metrics->coalesced.fetch_add(1, std::memory_order_relaxed);
+                    }
+
+                    if(! state.armed) {
+                        state.armTimer();
+                    }
+
+                    return RateVerdict::Shed;
+                }
+                break;
+
+            case RatePolicy::Drop:
+                break;
+        }
+
+        if(System::logThrottled(state.shed)) {
+            spdlog::warn("{}: rate limit, path: {}, shed: {}", __FUNCTION__, path, state.shed);
+        }
+
+        if(state.metrics) {
+            state.metrics->shed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        return RateVerdict::Shed;
+    }
+
+    void RateLimiter::status(const std::string & job) const {
+        std::scoped_lock guard{ state_->lock };
+        spdlog::info("{}: job: {}, rate: {}/s, burst: {}, tokens: {}, pending: {}, shed: {}, coalesced: {}, deferred: {}", "RateLimiter",
+                        job, state_->rate, state_->burst, static_cast<size_t>(state_->tokens), state_->pending.size(), state_->shed, state_->coalesced, state_->deferred);
+    }
+}
@@ -0,0 +1,57 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_LIMITER_H_
+#define INOTIFY_LIMITER_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <memory>
+#include <string>
+#include <functional>
+#include <string_view>
+
+#include "inotify_metrics.h"
+
+namespace Inotify {
+    /// the events over the rate limit
+    enum class RatePolicy { Drop, Coalesce, Defer };
+
+    enum class RateVerdict {
+        // the token taken
+        Pass,
+        // dropped, or held by the coalesce policy
+        Shed,
+        // dispatch with the low priority
+        Deferred
+    };
+
+    /// path, mask, from: the old path of the rename
+    using RateFlushCb = std::function<void(const std::string &, uint32_t mask, const std::string &)>;
+
+    /// per job token bucket, the tokens are the commands (the events after the debounce)
+    /// coalesce: the latest event per path is held and flushed in order as the tokens refill
+    class RateLimiter : boost::noncopyable {
+        struct State;
+        std::shared_ptr<State> state_;
+
+      public:
+        /// rate: the events per second, burst: the bucket size
+        RateLimiter(boost::asio::io_context &, double rate, size_t burst, RatePolicy, JobMetricsPtr, RateFlushCb &&);
+        /// the coalesced events are dropped, the running flush is waited
+        ~RateLimiter();
+
+        RateVerdict admit(std::string_view path, uint32_t mask, std::string_view from = {});
+        void status(const std::string & job) const;
+    };
+}
+
+#endif // INOTIFY_LIMITER_H_
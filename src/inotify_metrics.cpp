@@ -0,0 +1,221 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "inotify_tools.h"
+#include "inotify_event.h"
+#include "inotify_metrics.h"
+
+namespace Inotify {
+    void Histogram::observe(uint64_t value) {
+        // the bucket upper bound: 2^index
+        size_t index = value > 1 ? 64 - __builtin_clzll(value - 1) : 0;
+
+        if(index > BUCKETS - 1) {
+            index = BUCKETS - 1;
+        }
+
+        buckets_[index].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Histogram::write(std::string & out, const std::string & name, const std::string & labels, double scale) const {
+        uint64_t total = 0;
+        auto sep = labels.empty() ? "" : ",";
+
+        for(size_t it = 0; it < BUCKETS; ++it) {
+            total += buckets_[it].load(std::memory_order_relaxed);
+
+            if(it < BUCKETS - 1) {
+                out.append(fmt::format("{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, sep, static_cast<double>(uint64_t(1) << it) * scale, total));
+            } else {
+                out.append(fmt::format("{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, sep, total));
+            }
+        }
+
+        out.append(fmt::format("{}_sum{{{}}} {}\n", name, labels, static_cast<double>(sum_.load(std::memory_order_relaxed)) * scale));
+        out.append(fmt::format("{}_count{{{}}} {}\n", name, labels, count_.load(std::memory_order_relaxed)));
+    }
+
+    JobMetricsPtr Metrics::addJob(const std::string & name) {
+        std::scoped_lock guard{ lock_ };
+        auto ptr = std::make_shared<JobMetrics>(name, ++jobSeq_);
+
+        jobs_.remove_if([](auto & weak){ return weak.expired(); });
+        jobs_.emplace_back(ptr);
+
+        return ptr;
+    }
+
+    std::string escapeLabel(const std::string & str) {
+        std::string res;
+        res.reserve(str.size());
+
+        for(auto ch : str) {
+            if(ch == '\\' || ch == '"') {
+                res.push_back('\\');
+                res.push_back(ch);
+            } else if(ch == '\n') {
+                res.append("\\n");
+            } else {
+                res.push_back(ch);
+            }
+        }
+
+        return res;
+    }
+
+    /// the path is not unique: the jobs of one dir differ by the commands or the events
+    static std::string jobLabels(const JobMetrics & job) {
+        return fmt::format("job=\"{}\",id=\"{}\"", escapeLabel(job.job), job.id);
+    }
+
+    std::string Metrics::prometheus(void) const {
+        std::string out;
+        const std::string prefix{"inotify_watcher_"};
+
+        out.append("# TYPE inotify_watcher_reads_total counter\n");
+        out.append(fmt::format("{}reads_total {}\n", prefix, reads.load()));
+        out.append("# TYPE inotify_watcher_read_bytes_total counter\n");
+        out.append(fmt::format("{}read_bytes_total {}\n", prefix, readBytes.load()));
+        out.append("# TYPE inotify_watcher_queue_overflows_total counter\n");
+        out.append(fmt::format("{}queue_overflows_total {}\n", prefix, overflows.load()));
+        out.append("# TYPE inotify_watcher_journal_appended_total counter\n");
+        out.append(fmt::format("{}journal_appended_total {}\n", prefix, journalAppended.load()));
+        out.append("# TYPE inotify_watcher_journal_acked_total counter\n");
+        out.append(fmt::format("{}journal_acked_total {}\n", prefix, journalAcked.load()));
+        out.append("# TYPE inotify_watcher_journal_lost_total counter\n");
+        out.append(fmt::format("{}journal_lost_total {}\n", prefix, journalLost.load()));
+        out.append("# TYPE inotify_watcher_watches_used gauge\n");
+        out.append(fmt::format("{}watches_used {}\n", prefix, watchesUsed.load()));
+        out.append("# TYPE inotify_watcher_watches_limit gauge\n");
+        out.append(fmt::format("{}watches_limit {}\n", prefix, watchesLimit.load()));
+        out.append("# TYPE inotify_watcher_watches_polled gauge\n");
+        out.append(fmt::format("{}watches_polled {}\n", prefix, watchesPolled.load()));
+        out.append("# TYPE inotify_watcher_watches_evicted_total counter\n");
+        out.append(fmt::format("{}watches_evicted_total {}\n", prefix, watchesEvicted.load()));
+        out.append("# TYPE inotify_watcher_uring_submits_total counter\n");
+        out.append(fmt::format("{}uring_submits_total {}\n", prefix, ringSubmits.load()));
+        out.append("# TYPE inotify_watcher_uring_completions_total counter\n");
+        out.append(fmt::format("{}uring_completions_total {}\n", prefix, ringCompletions.load()));
+#ifdef INOTIFY_WATCHER_ALLOC_COUNT
+        // the benchmark build
+        out.append("# TYPE inotify_watcher_heap_allocations_total counter\n");
+        out.append(fmt::format("{}heap_allocations_total {}\n", prefix, heapAllocations()));
+#endif
+        out.append("# TYPE inotify_watcher_read_size_bytes histogram\n");
+        readSize.write(out, prefix + "read_size_bytes", "", 1.0);
+
+        std::list<JobMetricsPtr> jobs;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            for(auto & weak : jobs_) {
+                if(auto ptr = weak.lock()) {
+                    jobs.emplace_back(std::move(ptr));
+                }
+            }
+        }
+
+        const std::pair<const char*, std::array<Counter, EVENT_TYPES> JobMetrics::*> events[] = {
+            { "events_received_total", & JobMetrics::received },
+            { "events_filtered_total", & JobMetrics::filtered },
+            { "events_dispatched_total", & JobMetrics::dispatched }
+        };
+
+        for(auto & [name, member] : events) {
+            out.append(fmt::format("# TYPE {}{} counter\n", prefix, name));
+
+            for(auto & job : jobs) {
+                auto labels = jobLabels(*job);
+
+                for(size_t it = 0; it < EVENT_TYPES; ++it) {
+                    if(auto val = ((*job).*member)[it].load(std::memory_order_relaxed)) {
+                        out.append(fmt::format("{}{}{{{},event=\"{}\"}} {}\n", prefix, name, labels, maskToName(1u << it), val));
+                    }
+                }
+            }
+        }
+
+        const std::pair<const char*, Counter JobMetrics::*> counters[] = {
+            { "commands_spawned_total", & JobMetrics::spawned },
+            { "commands_failed_total", & JobMetrics::failed },
+            { "commands_dropped_total", & JobMetrics::dropped },
+            { "events_shed_total", & JobMetrics::shed },
+            { "events_coalesced_total", & JobMetrics::coalesced },
+            { "events_deferred_total", & JobMetrics::deferred },
+            { "events_unchanged_total", & JobMetrics::unchanged },
+            { "actions_run_total", & JobMetrics::actions },
+            { "actions_failed_total", & JobMetrics::actionsFailed },
+            { "actions_dropped_total", & JobMetrics::actionsDropped }
+        };
+
+        for(auto & [name, member] : counters) {
+            out.append(fmt::format("# TYPE {}{} counter\n", prefix, name));
+
+            for(auto & job : jobs) {
+                out.append(fmt::format("{}{}{{{}}} {}\n", prefix, name, jobLabels(*job), ((*job).*member).load(std::memory_order_relaxed)));
+            }
+        }
+
+        out.append("# TYPE inotify_watcher_dispatch_latency_seconds histogram\n");
+
+        for(auto & job : jobs) {
+            job->dispatchLatency.write(out, prefix + "dispatch_latency_seconds", jobLabels(*job), 1e-6);
+        }
+
+        out.append("# TYPE inotify_watcher_command_latency_seconds histogram\n");
+
+        for(auto & job : jobs) {
+            job->commandLatency.write(out, prefix + "command_latency_seconds", jobLabels(*job), 1e-6);
+        }
+
+        return out;
+    }
+
+    bool Metrics::writeTextfile(const std::filesystem::path & path) const {
+        AllocCountPause pause;
+
+        // the collector must not read the partial file
+        auto tmp = path;
+        tmp += ".tmp";
+
+        {
+            std::ofstream ofs{tmp, std::ios::trunc};
+
+            if(! ofs) {
+                spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, tmp.native());
+                return false;
+            }
+
+            ofs << prometheus();
+        }
+
+        if(0 > rename(tmp.c_str(), path.c_str())) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "rename", strerror(errno), errno, path.native());
+            return false;
+        }
+
+        return true;
+    }
+
+    Metrics & metrics(void) {
+        static Metrics metrics;
+        return metrics;
+    }
+}
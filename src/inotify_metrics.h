@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_METRICS_H_
+#define INOTIFY_METRICS_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <list>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <filesystem>
+
+namespace Inotify {
+    using Counter = std::atomic<uint64_t>;
+
+    /// lock free, log2 buckets: 1, 2, 4 ... 2^23 units and +Inf
+    class Histogram : boost::noncopyable {
+      public:
+        static const size_t BUCKETS = 25;
+
+      private:
+        std::array<Counter, BUCKETS> buckets_{};
+        Counter count_{0};
+        Counter sum_{0};
+
+      public:
+        void observe(uint64_t value);
+        /// scale: the unit to the prometheus base unit
+        void write(std::string & out, const std::string & name, const std::string & labels, double scale) const;
+    };
+
+    /// IN_ACCESS ... IN_MOVE_SELF
+    const size_t EVENT_TYPES = 12;
+
+    /// per job, shared by all watches of the job, relaxed atomics only
+    struct JobMetrics : boost::noncopyable {
+        const std::string job;
+        // the jobs of one path: the series differ by the id label
+        const uint64_t id;
+
+        std::array<Counter, EVENT_TYPES> received{};
+        std::array<Counter, EVENT_TYPES> filtered{};
+        std::array<Counter, EVENT_TYPES> dispatched{};
+
+        Counter spawned{0};
+        Counter failed{0};
+        Counter dropped{0};
+        // over the rate limit: dropped, held by the coalesce, low priority
+        Counter shed{0};
+        Counter coalesced{0};
+        Counter deferred{0};
+        // skip_unchanged: the rewrite with the same content
+        Counter unchanged{0};
+        // the in-process action instead of the command
+        Counter actions{0};
+        Counter actionsFailed{0};
+        Counter actionsDropped{0};
+
+        // microseconds: the kernel read to the handler
+        Histogram dispatchLatency;
+        // microseconds: the dispatch to the command exit
+        Histogram commandLatency;
+
+        JobMetrics(const std::string & name, uint64_t seq) : job(name), id(seq) {}
+
+        static void count(std::array<Counter, EVENT_TYPES> & counters, uint32_t mask) {
+            for(size_t it = 0; it < EVENT_TYPES; ++it) {
+                if(mask & (1u << it)) {
+                    counters[it].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    using JobMetricsPtr = std::shared_ptr<JobMetrics>;
+
+    /// the service metrics, written as the prometheus textfile
+    class Metrics : boost::noncopyable {
+        mutable std::mutex lock_;
+        std::list<std::weak_ptr<JobMetrics>> jobs_;
+        uint64_t jobSeq_ = 0;
+
+      public:
+        Counter reads{0};
+        Counter readBytes{0};
+        Counter overflows{0};
+        // the event journal
+        Counter journalAppended{0};
+        Counter journalAcked{0};
+        Counter journalLost{0};
+        // the watch budget, the gauges
+        Counter watchesUsed{0};
+        Counter watchesLimit{0};
+        Counter watchesPolled{0};
+        Counter watchesEvicted{0};
+        // the io_uring engine: the completions per io_uring_enter
+        Counter ringSubmits{0};
+        Counter ringCompletions{0};
+        // bytes per read()
+        Histogram readSize;
+
+        JobMetricsPtr addJob(const std::string & name);
+
+        std::string prometheus(void) const;
+        /// written to the temp file and renamed
+        bool writeTextfile(const std::filesystem::path &) const;
+    };
+
+    /// the process wide metrics: the inotify instances, the fanotify groups and the jobs
+    Metrics & metrics(void);
+
+    inline uint64_t elapsedUs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+#endif // INOTIFY_METRICS_H_
@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_newdirs.h"
+
+namespace Inotify {
+    void NewDirs::add(const std::string & dir) {
+        std::scoped_lock guard{ lock_ };
+
+        // the dir created again: the old names are not the entries
+        auto & rec = dirs_[dir];
+        rec.scans++;
+        rec.names.clear();
+
+        added_++;
+    }
+
+    void NewDirs::done(const std::string & dir) {
+        std::scoped_lock guard{ lock_ };
+
+        if(auto it = dirs_.find(dir); it != dirs_.end() && 0 == --it->second.scans) {
+            dirs_.erase(it);
+        }
+    }
+
+    bool NewDirs::first(std::string_view path) {
+        auto pos = path.rfind('/');
+
+        if(pos == std::string_view::npos) {
+            return true;
+        }
+
+        std::scoped_lock guard{ lock_ };
+
+        // the steady state: no new dirs
+        if(dirs_.empty()) {
+            return true;
+        }
+
+        auto it = dirs_.find(std::string(path.substr(0, pos)));
+
+        if(it == dirs_.end()) {
+            return true;
+        }
+
+        if(it->second.names.emplace(path.substr(pos + 1)).second) {
+            return true;
+        }
+
+        duplicates_++;
+        return false;
+    }
+
+    void NewDirs::forget(std::string_view path) {
+        auto pos = path.rfind('/');
+
+        if(pos == std::string_view::npos) {
+            return;
+        }
+
+        std::scoped_lock guard{ lock_ };
+
+        if(dirs_.empty()) {
+            return;
+        }
+
+        if(auto it = dirs_.find(std::string(path.substr(0, pos))); it != dirs_.end()) {
+            it->second.names.erase(std::string(path.substr(pos + 1)));
+        }
+    }
+
+    void NewDirs::status(const std::string & job) const {
+        std::scoped_lock guard{ lock_ };
+        spdlog::info("{}: job: {}, tracked: {}, added: {}, duplicates: {}", "NewDirs", job, dirs_.size(), added_, duplicates_);
+    }
+}
@@ -0,0 +1,52 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_NEWDIRS_H_
+#define INOTIFY_NEWDIRS_H_
+
+#include <boost/core/noncopyable.hpp>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Inotify {
+    /// the new subdirectories of the recursive job: the entries created before the watch are scanned,
+    /// the scanned and the kernel IN_CREATE of the same entry are dispatched once
+    class NewDirs : boost::noncopyable {
+        struct Dir {
+            // the scans not done
+            size_t scans = 0;
+            std::unordered_set<std::string> names;
+        };
+
+        mutable std::mutex lock_;
+        std::unordered_map<std::string, Dir> dirs_;
+
+        uint64_t added_ = 0;
+        uint64_t duplicates_ = 0;
+
+      public:
+        /// before the watch: the entries of the dir are tracked
+        void add(const std::string & dir);
+        /// the scan is done and the kernel events queued before its end are handled: the dir is not tracked
+        void done(const std::string & dir);
+        /// false: the entry of the new dir is already dispatched
+        bool first(std::string_view path);
+        /// the entry deleted: the next create is the new one
+        void forget(std::string_view path);
+
+        void status(const std::string & job) const;
+    };
+}
+
+#endif // INOTIFY_NEWDIRS_H_
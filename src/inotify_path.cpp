@@ -8,7 +8,12 @@
  *                                                                         *
  ***************************************************************************/
 
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
 #include <stdexcept>
+#include <system_error>
 #include <spdlog/spdlog.h>
 
 #include"inotify_path.h"
@@ -16,11 +21,78 @@
 using namespace boost;
 
 namespace Inotify {
-    void Path::cancelAsync(void) {
+    /* Instance */
+    Instance::Instance(asio::io_context & ioc, std::chrono::milliseconds move_timeout, Uring* uring)
+        : sd_(ioc), uring_(uring), strand_(asio::make_strand(ioc)), readMemory_(std::make_shared<HandlerMemory>(2, 256)),
+            moveTimer_(strand_), moveTimeout_(move_timeout), ioc_(ioc) {
+        fd_ = inotify_init1(IN_NONBLOCK);
+
+        if(fd_ < 0) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_init", strerror(errno), errno);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        if(uring_) {
+            // the ring buffer: the read may complete after the instance
+            ringReader_ = uring_->addReader(fd_, buf_.size(), [this](int res, const char* data) {
+                if(0 > res) {
+                    spdlog::error("{}: {} failed, error: {}, errno: {}", "Instance", "uring read", strerror(-res), -res);
+                    return false;
+                }
+
+                std::scoped_lock guard{ this->readLock_ };
+                return this->readComplete(data, res);
+            });
+
+            return;
+        }
+
+        sd_.assign(fd_);
+
+        readNext();
+    }
+
+    Instance::~Instance() {
+        moveTimer_.cancel();
+
+        if(uring_) {
+            uring_->removeReader(ringReader_);
+            close(fd_);
+            return;
+        }
+
         sd_.cancel();
+        // sd_ owns and closes fd_
+    }
+
+    void Instance::readNext(void) {
+        // one wait at a time, the handler memory is reused
+        sd_.async_wait(asio::posix::stream_descriptor::wait_read,
+            asio::bind_executor(strand_, makeAllocHandler(readMemory_, [this](const system::error_code & ec) {
+                this->readNotify(ec);
+            })));
+    }
+
+    ssize_t Instance::readEvents(void) {
+        // the read and the parse together: afterQueued sees no bytes between them
+        std::scoped_lock guard{ readLock_ };
+        auto recv = read(fd_, buf_.data(), buf_.size());
+
+        if(0 > recv) {
+            if(errno == EAGAIN || errno == EINTR) {
+                return 0;
+            }
+
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "read", strerror(errno), errno);
+            return -1;
+        }
+
+        return readComplete(buf_.data(), recv) ? recv : -1;
     }
 
-    bool Path::parseEvents(const char* beg, const char* end) {
+    bool Instance::parseEvents(const char* beg, const char* end) {
+        std::scoped_lock guard{ lock_ };
+
         while(beg < end) {
             auto st = (struct inotify_event*) beg;
 
@@ -29,145 +101,501 @@ namespace Inotify {
                 return false;
             }
 
-            if(st->mask & (IN_IGNORED)) {
-                beg += sizeof(struct inotify_event) + st->len;
+            beg += sizeof(struct inotify_event) + st->len;
+
+            if(st->mask & (IN_Q_OVERFLOW)) {
+                // wd: -1, all watches of the instance are affected
+                overflows_++;
+                metrics().overflows.fetch_add(1, std::memory_order_relaxed);
+                spdlog::warn("{}: queue overflow, instance: {:016x}, count: {}", __FUNCTION__, reinterpret_cast<uint64_t>(this), overflows_);
+                // the pairs are lost
+                flushMoves(true);
+
+                for(auto & [wd, paths] : watches_) {
+                    for(auto & path : paths) {
+                        path->dispatchEvent(IN_Q_OVERFLOW, nullptr);
+                    }
+                }
+
                 continue;
             }
 
-            std::string name;
+            auto it = watches_.find(st->wd);
 
-            if(st->len) {
-                name.assign(st->name);
+            if(it == watches_.end()) {
+                continue;
             }
 
-            if(st->mask & (IN_CREATE)) {
-                asio::post(ioc_, std::bind(& Path::inCreateEvent, this, path_, name));
+            if(st->mask & (IN_IGNORED)) {
+                // watch removed by kernel: deleted, unmounted or rm_watch
+                for(auto & path : it->second) {
+                    path->wd_ = -1;
+                }
+
+                watches_.erase(it);
+                continue;
             }
 
-            if(st->mask & (IN_OPEN)) {
-                asio::post(ioc_, std::bind(& Path::inOpenEvent, this, path_, name));
+            if((st->mask & IN_MOVED_FROM) && st->cookie) {
+                // usually the next record is the pair
+                moves_.push_back(MoveFrom{st->cookie, st->wd, st->mask, std::string(st->len ? st->name : ""), std::chrono::steady_clock::now()});
+                continue;
             }
 
-            if(st->mask & (IN_ACCESS)) {
-                asio::post(ioc_, std::bind(& Path::inAccessEvent, this, path_, name));
+            if((st->mask & IN_MOVED_TO) && st->cookie) {
+                if(auto mv = std::find_if(moves_.begin(), moves_.end(), [cookie = st->cookie](auto & from){ return from.cookie == cookie; }); mv != moves_.end()) {
+                    pairMove(*mv, st);
+                    moves_.erase(mv);
+                    continue;
+                }
             }
 
-            if(st->mask & (IN_MODIFY)) {
-                asio::post(ioc_, std::bind(& Path::inModifyEvent, this, path_, name));
+            for(auto & path : it->second) {
+                path->dispatchEvent(st->mask, st->len ? st->name : nullptr);
             }
+        }
 
-            if(st->mask & (IN_ATTRIB)) {
-                asio::post(ioc_, std::bind(& Path::inAttribEvent, this, path_, name));
+        if(! moves_.empty() && ! moveArmed_) {
+            armMoveTimer();
+        }
+
+        return true;
+    }
+
+    void Instance::pairMove(const MoveFrom & from, const struct inotify_event* to) {
+        static const std::vector<Path*> none;
+
+        auto sit = watches_.find(from.wd);
+        auto tit = watches_.find(to->wd);
+
+        auto & sources = sit != watches_.end() ? sit->second : none;
+        auto & targets = tit != watches_.end() ? tit->second : none;
+
+        renames_++;
+
+        // the other trees: the plain halves
+        for(auto & path : sources) {
+            bool paired = std::any_of(targets.begin(), targets.end(), [&](auto & target){ return target->sameTree(*path); });
+            path->dispatchEvent(paired ? (from.mask | IN_MOVED_PAIRED) : from.mask, from.name.empty() ? nullptr : from.name.c_str());
+        }
+
+        for(auto & path : targets) {
+            auto source = std::find_if(sources.begin(), sources.end(), [&](auto & src){ return path->sameTree(*src); });
+
+            if(source == sources.end()) {
+                path->dispatchEvent(to->mask, to->len ? to->name : nullptr);
+                continue;
             }
 
-            if(st->mask & (IN_CLOSE_WRITE)) {
-                asio::post(ioc_, std::bind(& Path::inCloseEvent, this, path_, name, true));
+            auto old = (*source)->path();
+
+            if(from.name.size()) {
+                old /= from.name;
             }
 
-            if(st->mask & (IN_CLOSE_NOWRITE)) {
-                asio::post(ioc_, std::bind(& Path::inCloseEvent, this, path_, name, false));
+            // IN_MOVED_FROM: the mask of the source jobs, the rename handler dispatches the halves
+            path->dispatchEvent(to->mask | IN_MOVED_FROM, path->path_, to->len ? to->name : nullptr, old.native());
+        }
+    }
+
+    void Instance::flushMoves(bool all) {
+        auto now = std::chrono::steady_clock::now();
+
+        // moved out of the watched dirs
+        while(! moves_.empty() && (all || moves_.front().time + moveTimeout_ <= now)) {
+            auto & from = moves_.front();
+
+            if(auto it = watches_.find(from.wd); it != watches_.end()) {
+                for(auto & path : it->second) {
+                    path->dispatchEvent(from.mask, from.name.empty() ? nullptr : from.name.c_str());
+                }
             }
 
-            if(st->mask & (IN_MOVE)) {
-                asio::post(ioc_, std::bind(& Path::inMoveEvent, this, path_, name, false));
+            moves_.pop_front();
+        }
+    }
+
+    void Instance::armMoveTimer(void) {
+        moveArmed_ = true;
+        moveTimer_.expires_at(moves_.front().time + moveTimeout_);
+        moveTimer_.async_wait([this](const system::error_code & ec) {
+            if(ec) {
+                return;
             }
 
-            if(st->mask & (IN_MOVE_SELF)) {
-                asio::post(ioc_, std::bind(& Path::inMoveEvent, this, path_, name, true));
+            std::scoped_lock guard{ this->lock_ };
+            this->moveArmed_ = false;
+            this->flushMoves(false);
+
+            if(! this->moves_.empty()) {
+                this->armMoveTimer();
             }
+        });
+    }
 
-            if(st->mask & (IN_DELETE)) {
-                asio::post(ioc_, std::bind(& Path::inDeleteEvent, this, path_, name, false));
+    void Instance::readNotify(const system::error_code & ec) {
+        if(ec) {
+            // ref: https://stackoverflow.com/questions/21046742/using-boostsystemerror-code-in-c
+            if(ec.value() != system::errc::operation_canceled) {
+                spdlog::error("{}: {} error, code: {}, message: {}", __FUNCTION__, "wait", ec.value(), ec.message());
             }
 
-            if(st->mask & (IN_DELETE_SELF)) {
-                asio::post(ioc_, std::bind(& Path::inDeleteEvent, this, path_, name, true));
+            return;
+        }
+
+        ssize_t recv = 0;
+
+        // the edge triggered reactor: the queue is read until empty
+        do {
+            recv = readEvents();
+        } while(0 < recv);
+
+        if(0 == recv) {
+            // next async
+            readNext();
+        }
+    }
+
+    bool Instance::readComplete(const char* data, size_t recv) {
+        auto & stats = metrics();
+        stats.reads.fetch_add(1, std::memory_order_relaxed);
+        stats.readBytes.fetch_add(recv, std::memory_order_relaxed);
+        stats.readSize.observe(recv);
+
+        if(! parseEvents(data, data + recv)) {
+            return false;
+        }
+
+        parsed_ += recv;
+        uint64_t mark = parsed_;
+
+        // io_uring: the queue is empty, the next read is not queued yet, the bytes counted twice are parsed
+        if(uring_ && ! waiters_.empty()) {
+            int pending = 0;
+
+            if(0 == ioctl(fd_, FIONREAD, & pending) && 0 == pending) {
+                mark = UINT64_MAX;
             }
+        }
 
-            beg += sizeof(struct inotify_event) + st->len;
+        while(! waiters_.empty() && waiters_.front().first <= mark) {
+            waiters_.front().second();
+            waiters_.pop_front();
         }
 
         return true;
     }
 
-    void Path::readNotify(const system::error_code & ec, size_t recv) {
-        if(ec) {
-            // ref: https://stackoverflow.com/questions/21046742/using-boostsystemerror-code-in-c
-            if(ec.value() != system::errc::operation_canceled) {
-                spdlog::error("{}: {} error, code: {}, message: {}", __FUNCTION__, "read", ec.value(), ec.message());
+    void Instance::afterQueued(std::function<void()> && func) {
+        std::scoped_lock guard{ readLock_ };
+        int pending = 0;
+
+        if(0 > ioctl(fd_, FIONREAD, & pending)) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "ioctl", strerror(errno), errno);
+            pending = 0;
+        }
+
+        // io_uring: the completed read holds the events not parsed yet, after the ioctl: counted twice at worst
+        uint64_t mark = parsed_ + pending + (uring_ ? uring_->readyBytes(ringReader_) : 0);
+
+        if(mark <= parsed_) {
+            func();
+        } else {
+            waiters_.emplace_back(mark, std::move(func));
+        }
+    }
+
+    uint32_t Instance::watchEvents(int wd) const {
+        uint32_t events = 0;
+
+        if(auto it = watches_.find(wd); it != watches_.end()) {
+            for(auto & path : it->second) {
+                events |= path->events_;
             }
+        }
+
+        return events;
+    }
+
+    int Instance::addWatch(Path* path) {
+        std::scoped_lock guard{ lock_ };
+
+        // the inode may be already watched by other path, merge masks
+        int wd = inotify_add_watch(fd_, path->path_.c_str(), path->events_ | IN_MASK_ADD);
+
+        if(wd < 0) {
+            int err = errno;
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_add_watch", strerror(err), err);
+            // the caller tells ENOSPC from the others
+            return -err;
+        }
+
+        path->wd_ = wd;
+        watches_[wd].push_back(path);
+
+        return wd;
+    }
 
+    void Instance::removeWatch(Path* path) {
+        std::scoped_lock guard{ lock_ };
+
+        if(path->wd_ < 0) {
             return;
         }
 
-        if(! parseEvents(buf_.data(), buf_.data() + recv)) {
+        int wd = path->wd_;
+        path->wd_ = -1;
+
+        auto it = watches_.find(wd);
+
+        if(it == watches_.end()) {
             return;
         }
 
-        // next async
-        sd_.async_read_some(asio::buffer(buf_),
-            asio::bind_executor(strand_, 
-                std::bind(& Path::readNotify, this, asio::placeholders::error, asio::placeholders::bytes_transferred)));
+        auto & paths = it->second;
+        paths.erase(std::remove(paths.begin(), paths.end(), path), paths.end());
+
+        if(paths.empty()) {
+            watches_.erase(it);
+            inotify_rm_watch(fd_, wd);
+        } else {
+            // shrink mask to the remaining paths
+            inotify_add_watch(fd_, paths.front()->path().c_str(), watchEvents(wd));
+        }
     }
-    
-    bool Path::changeFilterEvents(uint32_t events) {
-        if(0 <= fd_) {
-            if(0 <= wd_) {
-                inotify_rm_watch(fd_, wd_);
+
+    bool Instance::changeWatch(Path* path) {
+        std::scoped_lock guard{ lock_ };
+
+        if(path->wd_ < 0) {
+            return false;
+        }
+
+        if(0 > inotify_add_watch(fd_, path->path().c_str(), watchEvents(path->wd_))) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_add_watch", strerror(errno), errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    size_t Instance::countWatches(void) const {
+        std::scoped_lock guard{ lock_ };
+        return watches_.size();
+    }
+
+    uint64_t Instance::countOverflows(void) const {
+        std::scoped_lock guard{ lock_ };
+        return overflows_;
+    }
+
+    uint64_t Instance::countRenames(void) const {
+        std::scoped_lock guard{ lock_ };
+        return renames_;
+    }
+
+    /* Path */
+    void Path::cancelAsync(void) {
+        if(inst_) {
+            inst_->removeWatch(this);
+        }
+    }
+
+    void Path::dispatchEvent(uint32_t mask, const char* name) {
+        dispatchEvent(mask, path_, name);
+    }
+
+    void Path::dispatchEvent(uint32_t mask, const std::filesystem::path & dir, const char* name0, std::string_view from) {
+        if(mask & (IN_Q_OVERFLOW)) {
+            // the parse thread: path_ is read by the handler on the strand, retarget assigns it there
+            postEvent([](Path* ptr) {
+                ptr->inOverflowEvent(ptr->path_);
+            });
+            return;
+        }
+
+        if(metrics_) {
+            // the paired source half is counted by the source watch
+            JobMetrics::count(metrics_->received, from.empty() ? mask : (mask & ~IN_MOVED_FROM));
+        }
+
+        if(0 == (mask & events_)) {
+            return;
+        }
+
+        // before any allocation
+        if(filter_ && name0 && ! filter_->matchName(name0, mask & IN_ISDIR)) {
+            if(metrics_) {
+                JobMetrics::count(metrics_->filtered, mask);
             }
 
-            wd_ = inotify_add_watch(fd_, path_.c_str(), events);
+            return;
+        }
+
+        auto ev = eventPool().acquire();
+        // the watch path is not copied
+        ev->assign(mask, & dir == & path_ ? std::string_view{} : std::string_view{dir.native()}, name0 ? std::string_view{name0} : std::string_view{});
+        ev->from.assign(from);
 
-            if(wd_ < 0) {
-                spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_add_watch", strerror(errno), errno);
-                return false;
+        std::scoped_lock guard{ queueLock_ };
+
+        if(queueTail_) {
+            queueTail_->next = ev;
+        } else {
+            queueHead_ = ev;
+        }
+
+        queueTail_ = ev;
+
+        if(drainPosted_) {
+            return;
+        }
+
+        drainPosted_ = true;
+
+        // one handler per queue drain, the memory is reused
+        asio::post(strand_, makeAllocHandler(drainMemory_, [weak = weak_from_this()]() {
+            if(auto ptr = weak.lock()) {
+                ptr->drainEvents();
             }
-            
-            return true;
+        }));
+    }
+
+    void Path::drainEvents(void) {
+        Event* head = nullptr;
+
+        {
+            std::scoped_lock guard{ queueLock_ };
+            head = queueHead_;
+            queueHead_ = queueTail_ = nullptr;
+            drainPosted_ = false;
+        }
+
+        for(auto ev = head; ev; ev = ev->next) {
+            handleEvent(*ev);
         }
-        
-        return false;
+
+        eventPool().release(head);
     }
 
-    Path::Path(asio::io_context & ioc, const std::filesystem::path & path, uint32_t events)
-        : sd_(ioc), strand_(asio::make_strand(ioc)), path_(path), ioc_(ioc) {
-        if(! std::filesystem::exists(path_)) {
-            spdlog::error("path not exists: {}", path_.c_str());
-            throw std::runtime_error(__FUNCTION__);
+    void Path::handleEvent(const Event & ev) {
+        if(metrics_) {
+            metrics_->dispatchLatency.observe(elapsedUs(ev.time));
         }
 
-        fd_ = inotify_init1(IN_NONBLOCK);
+        if(ev.from.size()) {
+            inRenameEvent(ev.dirLen ? std::filesystem::path{ev.dir()} : path_, ev.name(), ev.from);
+        } else if(ev.dirLen) {
+            handleEvent(ev.mask, std::filesystem::path{ev.dir()}, ev.name());
+        } else {
+            handleEvent(ev.mask, path_, ev.name());
+        }
+    }
 
-        if(fd_ < 0) {
-            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_init", strerror(errno), errno);
-            throw std::runtime_error(__FUNCTION__);
+    void Path::handleEvent(uint32_t mask, const std::filesystem::path & dir, std::string_view name) {
+        if(mask & (IN_CREATE)) {
+            inCreateEvent(dir, name, mask & IN_ISDIR);
         }
 
-        // watch directory for any activity and report it back to me
-        wd_ = inotify_add_watch(fd_, path_.c_str(), events);
+        if(mask & (IN_OPEN)) {
+            inOpenEvent(dir, name);
+        }
 
-        if(wd_ < 0) {
-            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "inotify_add_watch", strerror(errno), errno);
-            throw std::runtime_error(__FUNCTION__);
+        if(mask & (IN_ACCESS)) {
+            inAccessEvent(dir, name);
         }
 
-        sd_.assign(fd_);
-        spdlog::info("target: {}", path.native());
+        if(mask & (IN_MODIFY)) {
+            inModifyEvent(dir, name);
+        }
+
+        if(mask & (IN_ATTRIB)) {
+            inAttribEvent(dir, name);
+        }
+
+        if(mask & (IN_CLOSE_WRITE)) {
+            inCloseEvent(dir, name, true);
+        }
+
+        if(mask & (IN_CLOSE_NOWRITE)) {
+            inCloseEvent(dir, name, false);
+        }
+
+        if(mask & (IN_MOVED_PAIRED)) {
+            inRenameSourceEvent(dir, name);
+        } else if(mask & (IN_MOVE)) {
+            inMovedEvent(dir, name, mask & (IN_MOVE | IN_ISDIR));
+        }
+
+        if(mask & (IN_MOVE_SELF)) {
+            inMoveEvent(dir, name, true);
+        }
 
-        sd_.async_read_some(asio::buffer(buf_),
-            asio::bind_executor(strand_,
-                std::bind(& Path::readNotify, this, asio::placeholders::error, asio::placeholders::bytes_transferred)));
+        if(mask & (IN_DELETE)) {
+            inDeleteEvent(dir, name, false);
+        }
+
+        if(mask & (IN_DELETE_SELF)) {
+            inDeleteEvent(dir, name, true);
+        }
     }
 
-    Path::~Path() {
-        sd_.cancel();
+    void Path::retarget(const std::filesystem::path & path) {
+        // the handlers read path_ on the strand
+        asio::post(strand_, [weak = weak_from_this(), path]() {
+            if(auto ptr = weak.lock()) {
+                std::scoped_lock guard{ ptr->pathLock_ };
+                ptr->path_ = path;
+            }
+        });
+    }
 
-        if(0 <= wd_) {
-            inotify_rm_watch(fd_, wd_);
+    void Path::afterQueued(std::function<void()> && func) {
+        // the strand after the drains posted by the parse
+        auto post = [weak = weak_from_this(), func = std::move(func)]() {
+            if(auto ptr = weak.lock()) {
+                asio::post(ptr->strand_, func);
+            } else {
+                func();
+            }
+        };
+
+        if(inst_) {
+            inst_->afterQueued(std::move(post));
+        } else {
+            post();
         }
+    }
 
-        if(0 <= fd_) {
-            close(fd_);
+    bool Path::changeFilterEvents(uint32_t events) {
+        events_ = events;
+        return inst_ ? inst_->changeWatch(this) : true;
+    }
+
+    Path::Path(Instance & inst, const std::filesystem::path & path, uint32_t events, FilterPtr filter, JobMetricsPtr metrics)
+        : inst_(& inst), events_(events), path_(path), filter_(std::move(filter)), metrics_(std::move(metrics)),
+            drainMemory_(std::make_shared<HandlerMemory>(2, 128)), ioc_(inst.context()), strand_(asio::make_strand(ioc_)) {
+        if(! std::filesystem::exists(path_)) {
+            spdlog::error("path not exists: {}", path_.c_str());
+            throw std::system_error(ENOENT, std::generic_category(), __FUNCTION__);
         }
+
+        // watch directory for any activity and report it back to me
+        if(int err = inst_->addWatch(this); 0 > err) {
+            throw std::system_error(-err, std::generic_category(), __FUNCTION__);
+        }
+
+        spdlog::info("target: {}", path.native());
+    }
+
+    Path::Path(asio::io_context & ioc, const std::filesystem::path & path, uint32_t events, FilterPtr filter, JobMetricsPtr metrics)
+        : events_(events), path_(path), filter_(std::move(filter)), metrics_(std::move(metrics)),
+            drainMemory_(std::make_shared<HandlerMemory>(2, 128)), ioc_(ioc), strand_(asio::make_strand(ioc_)) {
+    }
+
+    Path::~Path() {
+        cancelAsync();
+        // not drained
+        eventPool().release(queueHead_);
     }
 }
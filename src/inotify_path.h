@@ -19,42 +19,195 @@
 #include <sys/inotify.h>
 
 #include <array>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <functional>
 #include <stdexcept>
 #include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+#include "inotify_event.h"
+#include "inotify_filter.h"
+#include "inotify_metrics.h"
+#include "inotify_uring.h"
 
 namespace Inotify {
-    class Path : boost::noncopyable {
+    class Path;
+    class Fanotify;
+
+    /// the source half of the paired rename, outside the kernel bits: the bookkeeping only, the rename is reported by the destination
+    const uint32_t IN_MOVED_PAIRED = 0x00010000;
+
+    /// shared inotify descriptor: one read loop, events dispatched by wd
+    /// IN_MOVED_FROM and IN_MOVED_TO are paired by cookie into one rename, the unpaired halves are dispatched after the timeout
+    class Instance : boost::noncopyable {
+        struct MoveFrom {
+            uint32_t cookie = 0;
+            int wd = -1;
+            uint32_t mask = 0;
+            std::string name;
+            std::chrono::steady_clock::time_point time;
+        };
+
         int fd_ = -1;
-        int wd_ = -1;
 
         boost::asio::posix::stream_descriptor sd_;
+        // the io_uring engine instead of sd_, nullptr: epoll
+        Uring* uring_ = nullptr;
+        uint64_t ringReader_ = 0;
         boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+        HandlerMemoryPtr readMemory_;
+
+        mutable std::mutex lock_;
+        // one inode may be watched by several paths, the kernel returns the same wd
+        std::unordered_map<int, std::vector<Path*>> watches_;
+        uint64_t overflows_ = 0;
+
+        // IN_MOVED_FROM waiting for the cookie, the cross-tree moves expire
+        std::deque<MoveFrom> moves_;
+        boost::asio::steady_timer moveTimer_;
+        const std::chrono::milliseconds moveTimeout_;
+        bool moveArmed_ = false;
+        uint64_t renames_ = 0;
+
+        // ref: man inotify, at least one event with NAME_MAX name
+        std::array<char, 64 * 1024> buf_;
+
+        // the read and the parse, the queue position is exact
+        std::mutex readLock_;
+        // the bytes of the stream parsed
+        uint64_t parsed_ = 0;
+        // the stream position and the callback, afterQueued
+        std::deque<std::pair<uint64_t, std::function<void()>>> waiters_;
+
+      protected:
+        boost::asio::io_context & ioc_;
+
+        void readNext(void);
+        ssize_t readEvents(void);
+        bool parseEvents(const char* beg, const char* end);
+        void readNotify(const boost::system::error_code & ec);
+        bool readComplete(const char* data, size_t recv);
+        uint32_t watchEvents(int wd) const;
+
+        void pairMove(const MoveFrom &, const struct inotify_event*);
+        void flushMoves(bool all);
+        void armMoveTimer(void);
+
+      public:
+        /// uring: the shared ring of the instances, nullptr: the asio reactor
+        Instance(boost::asio::io_context &, std::chrono::milliseconds move_timeout = std::chrono::milliseconds(20), Uring* uring = nullptr);
+        ~Instance();
 
+        /// the wd or -errno
+        int addWatch(Path*);
+        void removeWatch(Path*);
+        bool changeWatch(Path*);
+
+        /// the func runs after the events queued by the kernel before the call are parsed
+        void afterQueued(std::function<void()> &&);
+
+        size_t countWatches(void) const;
+        uint64_t countOverflows(void) const;
+        uint64_t countRenames(void) const;
+        boost::asio::io_context & context(void) { return ioc_; }
+    };
+
+    /// owned by shared_ptr: the posted handlers hold the weak reference only
+    class Path : boost::noncopyable, public std::enable_shared_from_this<Path> {
+        // nullptr: the events are fed by the other backend
+        Instance* inst_ = nullptr;
+        int wd_ = -1;
+        uint32_t events_ = 0;
+
+        // changed on the strand by the rename, path() for the other threads
         std::filesystem::path path_;
-        std::array<char, 1024> buf_;
+        mutable std::mutex pathLock_;
+        // the names checked before the event is posted
+        FilterPtr filter_;
+        JobMetricsPtr metrics_;
+
+        // the kernel events queued for the strand, one drain posted at a time
+        std::mutex queueLock_;
+        Event* queueHead_ = nullptr;
+        Event* queueTail_ = nullptr;
+        bool drainPosted_ = false;
+        HandlerMemoryPtr drainMemory_;
+
+        friend class Instance;
+        friend class Fanotify;
+
+        void drainEvents(void);
+        void handleEvent(const Event &);
 
       protected:
         boost::asio::io_context & ioc_;
+        // the events of the watch are handled in order, the other watches in parallel
+        boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+
+        template<typename Func>
+        void postEvent(Func && func) {
+            boost::asio::post(strand_, [weak = weak_from_this(), func = std::move(func), start = std::chrono::steady_clock::now()]() {
+                if(auto ptr = weak.lock()) {
+                    if(ptr->metrics_) {
+                        ptr->metrics_->dispatchLatency.observe(elapsedUs(start));
+                    }
+
+                    func(ptr.get());
+                }
+            });
+        }
 
         void cancelAsync(void);
-        bool parseEvents(const char* beg, const char* end);
-        void readNotify(const boost::system::error_code & ec, size_t recv);
+        void dispatchEvent(uint32_t mask, const char* name);
+        // the event of the other directory, the fanotify tree; from: the paired rename
+        void dispatchEvent(uint32_t mask, const std::filesystem::path & dir, const char* name, std::string_view from = {});
+        // the mask bits to the handlers, the name is valid for the call only
+        void handleEvent(uint32_t mask, const std::filesystem::path & dir, std::string_view name);
         bool changeFilterEvents(uint32_t);
 
       public:
-        Path(boost::asio::io_context &, const std::filesystem::path &, uint32_t events = IN_ALL_EVENTS);
+        Path(Instance &, const std::filesystem::path &, uint32_t events = IN_ALL_EVENTS, FilterPtr filter = nullptr, JobMetricsPtr metrics = nullptr);
+        // without inotify watch
+        Path(boost::asio::io_context &, const std::filesystem::path &, uint32_t events, FilterPtr filter = nullptr, JobMetricsPtr metrics = nullptr);
         virtual ~Path();
 
-        virtual void inOpenEvent(const std::filesystem::path &, std::string) {}
-        virtual void inAccessEvent(const std::filesystem::path &, std::string) {}
-        virtual void inModifyEvent(const std::filesystem::path &, std::string) {}
-        virtual void inAttribEvent(const std::filesystem::path &, std::string) {}
-        virtual void inCloseEvent(const std::filesystem::path &, std::string, bool write) {}
-        virtual void inMoveEvent(const std::filesystem::path &, std::string, bool self) {}
-        virtual void inCreateEvent(const std::filesystem::path &, std::string) {}
-        virtual void inDeleteEvent(const std::filesystem::path &, std::string, bool self) {}
+        virtual void inOpenEvent(const std::filesystem::path &, std::string_view) {}
+        virtual void inAccessEvent(const std::filesystem::path &, std::string_view) {}
+        virtual void inModifyEvent(const std::filesystem::path &, std::string_view) {}
+        virtual void inAttribEvent(const std::filesystem::path &, std::string_view) {}
+        virtual void inCloseEvent(const std::filesystem::path &, std::string_view, bool write) {}
+        virtual void inMoveEvent(const std::filesystem::path &, std::string_view, bool self) {}
+        /// the unpaired half, mask: IN_MOVED_FROM or IN_MOVED_TO with IN_ISDIR
+        virtual void inMovedEvent(const std::filesystem::path & path, std::string_view name, uint32_t mask) { inMoveEvent(path, name, false); }
+        /// the paired IN_MOVED_FROM and IN_MOVED_TO, from: the old path
+        virtual void inRenameEvent(const std::filesystem::path & path, std::string_view name, std::string_view) { inMoveEvent(path, name, false); }
+        /// the source dir of the paired rename
+        virtual void inRenameSourceEvent(const std::filesystem::path &, std::string_view) {}
+        /// isdir: the kernel IN_ISDIR, the symlink to the dir is not the dir
+        virtual void inCreateEvent(const std::filesystem::path &, std::string_view, bool isdir) {}
+        virtual void inDeleteEvent(const std::filesystem::path &, std::string_view, bool self) {}
+        // events lost, the kernel queue overflowed
+        virtual void inOverflowEvent(const std::filesystem::path &) {}
         
-        const std::filesystem::path & path(void) const { return path_; }
+        /// the renames between the watches of the same tree are paired
+        virtual bool sameTree(const Path & other) const { return this == & other; }
+
+        /// the watched dir renamed: the kernel watch is kept
+        void retarget(const std::filesystem::path &);
+
+        /// the func runs on the strand after the handlers of the events queued by the kernel before the call
+        void afterQueued(std::function<void()> &&);
+
+        std::filesystem::path path(void) const {
+            std::scoped_lock guard{ pathLock_ };
+            return path_;
+        }
+
         uint64_t job_id(void) const { return reinterpret_cast<uint64_t>(this); }
     };
 }
@@ -0,0 +1,70 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_PLUGIN_H_
+#define INOTIFY_PLUGIN_H_
+
+/* the action plugin C ABI: the shared object exports inotify_plugin_entry,
+   the structs are only extended at the end with the abi version bump */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INOTIFY_PLUGIN_ABI 1
+
+struct inotify_plugin_init {
+    /* the loader abi */
+    uint32_t abi;
+    /* the job path */
+    const char* job;
+    /* the "config" object of the job action, json */
+    const char* config;
+    /* the job owner, -1: the service user */
+    int64_t uid;
+    int64_t gid;
+};
+
+struct inotify_plugin_event {
+    /* IN_xxx, the merged events of the debounce */
+    uint32_t mask;
+    /* unix time, nanoseconds */
+    uint64_t time_ns;
+    const char* path;
+    /* the old path of the rename, NULL: not the rename */
+    const char* from;
+};
+
+struct inotify_plugin {
+    /* INOTIFY_PLUGIN_ABI of the plugin build */
+    uint32_t abi;
+    const char* name;
+
+    /* the job loaded: the plugin context, NULL: the job is skipped */
+    void* (*create)(const struct inotify_plugin_init* init);
+    /* the events of one job are serialized, the different jobs run in parallel
+       return 0: success, the journaled event is acknowledged */
+    int (*handle)(void* ctx, const struct inotify_plugin_event* event);
+    /* the job removed */
+    void (*destroy)(void* ctx);
+};
+
+typedef const struct inotify_plugin* (*inotify_plugin_entry_fn)(void);
+
+/* exported by the plugin */
+const struct inotify_plugin* inotify_plugin_entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INOTIFY_PLUGIN_H_ */
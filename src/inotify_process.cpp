@@ -0,0 +1,370 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <pwd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include <array>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "inotify_uring.h"
+#include "inotify_process.h"
+
+extern char** environ;
+
+using namespace boost;
+
+namespace System {
+    CredentialsPtr resolveOwner(const std::string & owner) {
+        if(0 != getuid() || owner.empty() || owner == "root") {
+            return nullptr;
+        }
+
+        struct passwd pwd, *res = nullptr;
+        std::array<char, 4096> buf;
+
+        if(0 != getpwnam_r(owner.c_str(), & pwd, buf.data(), buf.size(), & res) || ! res) {
+            spdlog::warn("{}: owner not found: {}", __FUNCTION__, owner);
+            return nullptr;
+        }
+
+        if(0 == res->pw_uid) {
+            return nullptr;
+        }
+
+        return std::make_shared<Credentials>(Credentials{res->pw_uid, res->pw_gid, res->pw_name, res->pw_dir});
+    }
+
+    pid_t spawnCommand(const Command & cmd, int* stdinfd) {
+        // prepare all in parent: the vfork child shares memory and may only do raw syscalls
+        const bool chown = !! cmd.owner;
+        const uid_t uid = chown ? cmd.owner->uid : 0;
+        const gid_t gid = chown ? cmd.owner->gid : 0;
+
+        std::vector<std::string> envs;
+
+        if(chown) {
+            envs.emplace_back(std::string("USER=").append(cmd.owner->user));
+            envs.emplace_back(std::string("LOGNAME=").append(cmd.owner->user));
+            envs.emplace_back(std::string("HOME=").append(cmd.owner->home));
+        }
+
+        std::vector<const char*> envp;
+
+        for(char** env = environ; env && *env; ++env) {
+            if(chown && (0 == strncmp(*env, "USER=", 5) ||
+                    0 == strncmp(*env, "LOGNAME=", 8) || 0 == strncmp(*env, "HOME=", 5))) {
+                continue;
+            }
+
+            envp.push_back(*env);
+        }
+
+        for(auto & env : envs) {
+            envp.push_back(env.c_str());
+        }
+
+        envp.push_back(nullptr);
+
+        std::vector<const char*> argv;
+        argv.reserve(cmd.args.size() + 2);
+
+        argv.push_back(cmd.cmd.c_str());
+
+        for(auto & val : cmd.args) {
+            argv.push_back(val.c_str());
+        }
+
+        argv.push_back(nullptr);
+
+        int pipefd[2] = { -1, -1 };
+
+        if(stdinfd && 0 > pipe2(pipefd, O_CLOEXEC)) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "pipe", strerror(errno), errno);
+            return -1;
+        }
+
+        // block signals: the asio handlers must not run in the child
+        sigset_t all, old;
+        sigfillset(& all);
+        pthread_sigmask(SIG_SETMASK, & all, & old);
+
+        pid_t pid = vfork();
+
+        if(0 == pid) {
+            // child mode, the ignored SIGPIPE also reset
+            for(int sig = 1; sig < NSIG; ++sig) {
+                struct sigaction sa;
+
+                if(0 == sigaction(sig, nullptr, & sa) && sa.sa_handler != SIG_DFL) {
+                    sa.sa_handler = SIG_DFL;
+                    sigaction(sig, & sa, nullptr);
+                }
+            }
+
+            pthread_sigmask(SIG_SETMASK, & old, nullptr);
+
+            // stdin, stdout, stderr
+            int fd = open("/dev/null", O_RDWR);
+
+            if(0 <= fd) {
+                dup2(0 <= pipefd[0] ? pipefd[0] : fd, 0);
+                dup2(fd, 1);
+                dup2(fd, 2);
+            }
+
+#ifdef SYS_close_range
+            if(0 > syscall(SYS_close_range, 3, ~0U, 0))
+#endif
+            for(int fd = 3; fd < 256; ++fd) {
+                close(fd);
+            }
+
+            // goto tmp
+            if(0 > chdir("/tmp")) {
+                _exit(126);
+            }
+
+            if(chown) {
+                // raw syscalls: the glibc wrappers broadcast setxid to the parent threads
+                syscall(SYS_setgroups, 1, & gid);
+                syscall(SYS_setgid, gid);
+
+                if(0 > syscall(SYS_setuid, uid)) {
+                    _exit(126);
+                }
+            }
+
+            execve(cmd.cmd.c_str(), (char* const*) argv.data(), (char* const*) envp.data());
+            _exit(127);
+        }
+
+        int err = errno;
+        pthread_sigmask(SIG_SETMASK, & old, nullptr);
+
+        if(0 <= pipefd[0]) {
+            close(pipefd[0]);
+        }
+
+        if(0 > pid) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "vfork", strerror(err), err);
+
+            if(0 <= pipefd[1]) {
+                close(pipefd[1]);
+            }
+        } else if(stdinfd) {
+            *stdinfd = pipefd[1];
+        }
+
+        return pid;
+    }
+
+    ProcessReaper::ProcessReaper(asio::io_context & ioc) : ioc_(ioc), sigchld_(ioc) {
+    }
+
+    ProcessReaper::~ProcessReaper() {
+        sigchld_.cancel();
+
+        std::list<uint64_t> waits;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            for(auto & [pid, child] : childs_) {
+                if(child->ringWait) {
+                    waits.push_back(child->ringWait);
+                }
+            }
+        }
+
+        // the running callback takes lock_
+        for(auto id : waits) {
+            uring_->removeReader(id);
+        }
+    }
+
+    void ProcessReaper::setUring(Inotify::Uring* uring) {
+        uring_ = uring;
+    }
+
+    void ProcessReaper::waitSigChild(void) {
+        sigchld_.async_wait([this](const system::error_code & ec, int signal) {
+            if(ec) {
+                return;
+            }
+
+            this->reapAll();
+            this->waitSigChild();
+        });
+    }
+
+    void ProcessReaper::reapAll(void) {
+        std::list<ChildPtr> childs;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            for(auto & [pid, child] : childs_) {
+                // waited by the pidfd: not reaped twice
+                if(! child->pidfd.is_open()) {
+                    childs.push_back(child);
+                }
+            }
+        }
+
+        for(auto & child : childs) {
+            reapChild(child, true);
+        }
+    }
+
+    bool ProcessReaper::reapChild(const ChildPtr & child, bool nohang) {
+        int status = 0;
+        pid_t res = waitpid(child->pid, & status, nohang ? WNOHANG : 0);
+
+        if(0 == res) {
+            // still running
+            return false;
+        }
+
+        {
+            std::scoped_lock guard{ lock_ };
+            childs_.erase(child->pid);
+        }
+
+        if(0 > res) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "waitpid", strerror(errno), errno);
+            return true;
+        }
+
+        auto runtime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - child->start);
+
+        if(WIFEXITED(status)) {
+            if(WEXITSTATUS(status)) {
+                spdlog::warn("{}: pid: {}, cmd: {}, exit code: {}, runtime: {}ms", __FUNCTION__, child->pid, child->cmd, WEXITSTATUS(status), runtime.count());
+            } else {
+                spdlog::info("{}: pid: {}, cmd: {}, exit code: {}, runtime: {}ms", __FUNCTION__, child->pid, child->cmd, 0, runtime.count());
+            }
+        } else if(WIFSIGNALED(status)) {
+            spdlog::warn("{}: pid: {}, cmd: {}, killed by signal: {}, runtime: {}ms", __FUNCTION__, child->pid, child->cmd, WTERMSIG(status), runtime.count());
+        }
+
+        if(child->exitCb) {
+            child->exitCb(child->pid, status, runtime);
+        }
+
+        return true;
+    }
+
+    pid_t ProcessReaper::runCommand(const Command & cmd, CommandExitCb && func) {
+        int stdinfd = -1;
+        pid_t pid = spawnChild(cmd, cmd.input.empty() ? nullptr : & stdinfd, std::move(func));
+
+        if(0 <= pid && 0 <= stdinfd) {
+            // the pipe is closed after write, SIGPIPE is ignored: the child may exit without reading
+            auto pipe = std::make_shared<asio::posix::stream_descriptor>(ioc_, stdinfd);
+            auto input = std::make_shared<std::string>(cmd.input);
+
+            asio::async_write(*pipe, asio::buffer(*input), [pipe, input, pid](const system::error_code & ec, size_t) {
+                if(ec) {
+                    spdlog::warn("{}: pid: {}, {} error, code: {}, message: {}", "runCommand", pid, "write", ec.value(), ec.message());
+                }
+            });
+        }
+
+        return pid;
+    }
+
+    pid_t ProcessReaper::runWorker(const Command & cmd, int & stdinfd, CommandExitCb && func) {
+        stdinfd = -1;
+        return spawnChild(cmd, & stdinfd, std::move(func));
+    }
+
+    pid_t ProcessReaper::spawnChild(const Command & cmd, int* stdinfd, CommandExitCb && func) {
+        auto child = std::make_shared<Child>(ioc_);
+        child->cmd = cmd.cmd;
+        child->exitCb = std::move(func);
+        child->start = std::chrono::steady_clock::now();
+        child->pid = spawnCommand(cmd, stdinfd);
+
+        if(0 > child->pid) {
+            return child->pid;
+        }
+
+        int pidfd = -1;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            if(pidfd_) {
+#ifdef SYS_pidfd_open
+                pidfd = syscall(SYS_pidfd_open, child->pid, 0);
+#else
+                errno = ENOSYS;
+#endif
+
+                if(0 > pidfd) {
+                    // kernel < 5.3: all by SIGCHLD, the transient error (EMFILE): this child only
+                    pidfd_ = errno != ENOSYS;
+                    spdlog::warn("{}: {} failed, error: {}, errno: {}, used SIGCHLD", __FUNCTION__, "pidfd_open", strerror(errno), errno);
+                }
+            }
+
+            if(0 > pidfd && ! sigchldAdded_) {
+                sigchldAdded_ = true;
+                sigchld_.add(SIGCHLD);
+                waitSigChild();
+            }
+
+            // before reapAll sees the child, the descriptor is owned by it
+            if(0 <= pidfd) {
+                child->pidfd.assign(pidfd);
+            }
+
+            childs_.emplace(child->pid, child);
+        }
+
+        if(0 <= pidfd && uring_) {
+            // the poll completes on the exit
+            child->ringWait = uring_->addWait(pidfd, [this, child](int res, const char*) {
+                if(0 <= res) {
+                    this->reapChild(child, false);
+                } else {
+                    spdlog::error("{}: {} failed, error: {}, errno: {}", "ProcessReaper", "uring poll", strerror(-res), -res);
+                }
+
+                return false;
+            });
+        } else if(0 <= pidfd) {
+            child->pidfd.async_wait(asio::posix::stream_descriptor::wait_read, [this, child](const system::error_code & ec) {
+                if(! ec) {
+                    this->reapChild(child, false);
+                }
+            });
+        } else {
+            // the child may exit before registration
+            asio::post(ioc_, std::bind(& ProcessReaper::reapAll, this));
+        }
+
+        return child->pid;
+    }
+
+    size_t ProcessReaper::countRunning(void) const {
+        std::scoped_lock guard{ lock_ };
+        return childs_.size();
+    }
+}
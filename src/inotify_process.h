@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_PROCESS_H_
+#define INOTIFY_PROCESS_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <sys/types.h>
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+namespace Inotify {
+    class Uring;
+}
+
+namespace System {
+    /// the command owner, resolved once on the job load
+    struct Credentials {
+        uid_t uid = 0;
+        gid_t gid = 0;
+        std::string user;
+        std::string home;
+    };
+
+    using CredentialsPtr = std::shared_ptr<const Credentials>;
+
+    /// return nullptr: run as the service user (not root, unknown or root owner)
+    CredentialsPtr resolveOwner(const std::string & owner);
+
+    struct Command {
+        std::string cmd;
+        std::list<std::string> args;
+        CredentialsPtr owner;
+        // written to the child stdin, empty: /dev/null
+        std::string input;
+        // the executor result: false on the drop, the spawn error or the exit status
+        std::function<void(bool success)> done;
+    };
+
+    /// status: waitpid status, runtime: from spawn to reap
+    using CommandExitCb = std::function<void(pid_t pid, int status, std::chrono::milliseconds runtime)>;
+
+    /// vfork/exec without waiting, return child pid or -1
+    /// stdinfd: if set, the child stdin is a pipe, the write end is returned here
+    pid_t spawnCommand(const Command &, int* stdinfd = nullptr);
+
+    /// spawn commands and reap the childs asynchronously (pidfd, or SIGCHLD on old kernels)
+    class ProcessReaper : boost::noncopyable {
+        struct Child {
+            pid_t pid = -1;
+            std::string cmd;
+            std::chrono::steady_clock::time_point start;
+            CommandExitCb exitCb;
+            boost::asio::posix::stream_descriptor pidfd;
+            // the pidfd wait on the ring
+            uint64_t ringWait = 0;
+
+            Child(boost::asio::io_context & ioc) : pidfd(ioc) {}
+        };
+
+        using ChildPtr = std::shared_ptr<Child>;
+
+        boost::asio::io_context & ioc_;
+        boost::asio::signal_set sigchld_;
+
+        mutable std::mutex lock_;
+        std::unordered_map<pid_t, ChildPtr> childs_;
+        bool pidfd_ = true;
+        // the children without the pidfd are reaped by SIGCHLD
+        bool sigchldAdded_ = false;
+        Inotify::Uring* uring_ = nullptr;
+
+      protected:
+        void waitSigChild(void);
+        void reapAll(void);
+        bool reapChild(const ChildPtr &, bool nohang);
+        pid_t spawnChild(const Command &, int* stdinfd, CommandExitCb &&);
+
+      public:
+        ProcessReaper(boost::asio::io_context &);
+        ~ProcessReaper();
+
+        /// the pidfd waits on the io_uring engine instead of the asio reactor, the ring outlives the reaper
+        void setUring(Inotify::Uring*);
+
+        pid_t runCommand(const Command &, CommandExitCb && = nullptr);
+        /// the long-lived child: the stdin pipe write end is returned, owned by the caller
+        pid_t runWorker(const Command &, int & stdinfd, CommandExitCb &&);
+        size_t countRunning(void) const;
+    };
+}
+
+#endif // INOTIFY_PROCESS_H_
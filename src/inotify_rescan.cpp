@@ -0,0 +1,237 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_uring.h"
+#include "inotify_rescan.h"
+
+using namespace boost;
+
+namespace Inotify {
+    bool statEntry(int dirfd, const char* name, FileState & res) {
+        struct stat st;
+
+        if(0 > fstatat(dirfd, name, & st, AT_SYMLINK_NOFOLLOW)) {
+            return false;
+        }
+
+        res.ino = st.st_ino;
+        res.size = st.st_size;
+        res.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        res.dir = S_ISDIR(st.st_mode);
+
+        return true;
+    }
+
+    void statxEntry(const struct statx & stx, FileState & res) {
+        res.ino = stx.stx_ino;
+        res.size = stx.stx_size;
+        res.mtime = static_cast<int64_t>(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+        res.dir = S_ISDIR(stx.stx_mode);
+    }
+
+    /* Snapshot */
+    void Snapshot::update(const std::filesystem::path & dir, std::string_view name, uint32_t mask) {
+        if(name.empty() || 0 == (mask & (IN_CREATE | IN_DELETE | IN_MOVE | IN_CLOSE_WRITE | IN_ATTRIB))) {
+            return;
+        }
+
+        // the per bit events lost the move direction: the current state is the truth
+        FileState st;
+        bool exists = statEntry(AT_FDCWD, (dir / name).c_str(), st);
+
+        std::scoped_lock guard{ lock_ };
+
+        if(exists) {
+            entries_[std::string(name)] = st;
+        } else {
+            entries_.erase(std::string(name));
+        }
+    }
+
+    SnapshotEvents Snapshot::rescan(const std::filesystem::path & dir, bool synthesize, UringScan* ring) {
+        SnapshotEvents res;
+        std::unordered_map<std::string, FileState> entries;
+
+        int dirfd = ring ? ring->openAt(AT_FDCWD, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) :
+                            open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if(ring && 0 > dirfd) {
+            errno = -dirfd;
+        }
+
+        if(0 > dirfd) {
+            spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, dir.native());
+            return res;
+        }
+
+        // closes dirfd
+        DIR* dp = fdopendir(dirfd);
+
+        if(! dp) {
+            close(dirfd);
+            return res;
+        }
+
+        // the ring: the names first, the stats by one submit
+        std::vector<std::string> names;
+
+        while(auto ent = readdir(dp)) {
+            if(0 == strcmp(ent->d_name, ".") || 0 == strcmp(ent->d_name, "..")) {
+                continue;
+            }
+
+            if(ring) {
+                names.emplace_back(ent->d_name);
+                continue;
+            }
+
+            FileState st;
+
+            if(statEntry(dirfd, ent->d_name, st)) {
+                entries.emplace(ent->d_name, st);
+            }
+        }
+
+        if(ring && names.size()) {
+            std::vector<UringStat> stats(names.size());
+
+            for(size_t it = 0; it < names.size(); ++it) {
+                stats[it].name = names[it].c_str();
+            }
+
+            ring->statAt(dirfd, stats);
+
+            for(size_t it = 0; it < names.size(); ++it) {
+                // removed after the readdir
+                if(0 == stats[it].res) {
+                    statxEntry(stats[it].stx, entries[std::move(names[it])]);
+                }
+            }
+        }
+
+        closedir(dp);
+
+        std::scoped_lock guard{ lock_ };
+
+        if(synthesize) {
+            for(auto & [name, st] : entries) {
+                auto it = entries_.find(name);
+
+                if(it == entries_.end()) {
+                    res.emplace_back(name, st.dir ? (IN_CREATE | IN_ISDIR) : (IN_CREATE | IN_CLOSE_WRITE));
+                } else if(it->second != st) {
+                    if(! st.dir) {
+                        res.emplace_back(name, it->second.ino != st.ino ? (IN_CREATE | IN_CLOSE_WRITE) : (IN_MODIFY | IN_CLOSE_WRITE));
+                    }
+                }
+            }
+
+            for(auto & [name, st] : entries_) {
+                if(! entries.count(name)) {
+                    res.emplace_back(name, st.dir ? (IN_DELETE | IN_ISDIR) : IN_DELETE);
+                }
+            }
+        }
+
+        entries_.swap(entries);
+        return res;
+    }
+
+    size_t Snapshot::size(void) const {
+        std::scoped_lock guard{ lock_ };
+        return entries_.size();
+    }
+
+    /* RescanScheduler */
+    RescanScheduler::RescanScheduler(RescanCb && func)
+        : timer_(pool_.get_executor()), rescanCb_(std::move(func)) {
+    }
+
+    RescanScheduler::~RescanScheduler() {
+        timer_.cancel();
+        pool_.stop();
+        pool_.join();
+    }
+
+    void RescanScheduler::setRate(size_t dirs_per_sec) {
+        std::scoped_lock guard{ lock_ };
+        interval_ = std::chrono::milliseconds(1000 / std::max(dirs_per_sec, size_t(1)));
+    }
+
+    void RescanScheduler::schedule(uint64_t job_id, bool synthesize) {
+        std::scoped_lock guard{ lock_ };
+        auto [it, inserted] = queued_.emplace(job_id, synthesize);
+
+        if(! inserted) {
+            // no synthesize before the first snapshot
+            return;
+        }
+
+        queue_.push_back(job_id);
+
+        if(! armed_) {
+            armed_ = true;
+            timer_.expires_after(interval_);
+            timer_.async_wait(std::bind(& RescanScheduler::timerEvent, this, std::placeholders::_1));
+        }
+    }
+
+    void RescanScheduler::timerEvent(const system::error_code & ec) {
+        if(ec) {
+            return;
+        }
+
+        uint64_t job_id = 0;
+        bool synthesize = false;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            if(queue_.empty()) {
+                armed_ = false;
+                return;
+            }
+
+            job_id = queue_.front();
+            queue_.pop_front();
+
+            synthesize = queued_[job_id];
+            queued_.erase(job_id);
+            rescans_++;
+        }
+
+        // on the pool thread
+        rescanCb_(job_id, synthesize);
+
+        std::scoped_lock guard{ lock_ };
+
+        if(queue_.empty()) {
+            armed_ = false;
+        } else {
+            timer_.expires_after(interval_);
+            timer_.async_wait(std::bind(& RescanScheduler::timerEvent, this, std::placeholders::_1));
+        }
+    }
+
+    void RescanScheduler::status(void) const {
+        std::scoped_lock guard{ lock_ };
+        spdlog::info("{}: rescans: {}, queued: {}, interval: {}ms", __FUNCTION__, rescans_, queue_.size(), interval_.count());
+    }
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_RESCAN_H_
+#define INOTIFY_RESCAN_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <sys/types.h>
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+
+namespace Inotify {
+    class UringScan;
+
+    struct FileState {
+        ino_t ino = 0;
+        off_t size = 0;
+        int64_t mtime = 0;
+        bool dir = false;
+
+        bool operator==(const FileState & st) const {
+            return ino == st.ino && size == st.size && mtime == st.mtime && dir == st.dir;
+        }
+
+        bool operator!=(const FileState & st) const {
+            return ! (*this == st);
+        }
+    };
+
+    using SnapshotEvents = std::vector<std::pair<std::string, uint32_t>>;
+
+    /// cached state of the directory entries, kept in sync by the delivered events
+    class Snapshot : boost::noncopyable {
+        mutable std::mutex lock_;
+        std::unordered_map<std::string, FileState> entries_;
+
+      public:
+        Snapshot() = default;
+
+        /// IN_MODIFY is skipped: the IN_CLOSE_WRITE of the write syncs the entry
+        void update(const std::filesystem::path & dir, std::string_view name, uint32_t mask);
+        /// ring: the openat and the statx batch of the entries on the scan ring, nullptr: the syscall per entry
+        SnapshotEvents rescan(const std::filesystem::path & dir, bool synthesize, UringScan* ring = nullptr);
+
+        size_t size(void) const;
+    };
+
+    using RescanCb = std::function<void(uint64_t job_id, bool synthesize)>;
+
+    /// rate-limited rescans, executed on own thread: off the event loop
+    class RescanScheduler : boost::noncopyable {
+        boost::asio::thread_pool pool_{1};
+        boost::asio::steady_timer timer_;
+        RescanCb rescanCb_;
+
+        mutable std::mutex lock_;
+        std::deque<uint64_t> queue_;
+        // job_id: synthesize
+        std::unordered_map<uint64_t, bool> queued_;
+        std::chrono::milliseconds interval_{20};
+        bool armed_ = false;
+        uint64_t rescans_ = 0;
+
+      protected:
+        void timerEvent(const boost::system::error_code &);
+
+      public:
+        RescanScheduler(RescanCb &&);
+        ~RescanScheduler();
+
+        void setRate(size_t dirs_per_sec);
+        void schedule(uint64_t job_id, bool synthesize);
+
+        void status(void) const;
+    };
+}
+
+#endif // INOTIFY_RESCAN_H_
@@ -9,140 +9,342 @@
  ***************************************************************************/
 
 #include <boost/json.hpp>
-#include <boost/algorithm/string/join.hpp>
 
+#include <map>
 #include <list>
 #include <mutex>
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <functional>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <systemd/sd-daemon.h>
 
 #include "spdlog/spdlog.h"
 #include "spdlog/sinks/systemd_sink.h"
 
+#include "inotify_job.h"
 #include "inotify_path.h"
 #include "inotify_tools.h"
+#include "inotify_process.h"
+#include "inotify_executor.h"
+#include "inotify_debounce.h"
+#include "inotify_batch.h"
+#include "inotify_limiter.h"
+#include "inotify_rescan.h"
+#include "inotify_walker.h"
+#include "inotify_worker.h"
+#include "inotify_metrics.h"
+#include "inotify_journal.h"
+#include "inotify_newdirs.h"
+#include "inotify_budget.h"
+#include "inotify_control.h"
+#include "inotify_unchanged.h"
+#include "inotify_action.h"
+#include "inotify_fanotify.h"
 
 using namespace boost;
-using InotifyPathPtr = std::unique_ptr<Inotify::Path>;
 using ConfFileModifyEventCb = std::function<void(const std::filesystem::path &)>;
-using ConfDirModifyEventCb = std::function<void(const std::filesystem::path &, uint32_t, uint64_t)>;
-using JobContinueEventCb = std::function<void(const std::filesystem::path &, uint32_t, const json::object &, uint64_t)>;
-
-namespace Inotify {
-    uint32_t jsonArrayToEvents(const json::array & ar) {
-        std::vector<std::string> names;
-        json::parse_into(names, json::serialize(ar));
-        uint32_t events = 0;
-        for(auto & name: names) {
-            events |= Inotify::nameToMask(name);
+using ConfDirModifyEventCb = std::function<void(const std::filesystem::path &, uint32_t)>;
+using JobGroupPtr = System::CommandExecutor::GroupPtr;
+
+/// runtime state shared by all watches of the job
+struct JobRuntime {
+    Inotify::JobDescPtr desc;
+    JobGroupPtr group;
+    std::unique_ptr<Inotify::Debouncer> debouncer;
+    std::unique_ptr<Inotify::Batcher> batcher;
+    std::unique_ptr<Inotify::RateLimiter> limiter;
+    // the recursive inotify job: the created subdirs
+    std::unique_ptr<Inotify::NewDirs> newDirs;
+    // skip_unchanged: before the limiter
+    std::unique_ptr<Inotify::UnchangedFilter> unchanged;
+    std::unique_ptr<Inotify::ActionRunner> action;
+    System::WorkerPtr worker;
+    Inotify::JobMetricsPtr metrics;
+
+    ~JobRuntime() {
+        // the flush reaches the members below: the running one is waited first
+        debouncer.reset();
+        // the hash pool callback reaches the limiter, the action and the worker: stopped before them
+        unchanged.reset();
+        limiter.reset();
+        batcher.reset();
+
+        if(worker) {
+            worker->stop();
         }
-        return events;
     }
 
-    const uint32_t EVENTS_BASE = IN_CLOSE_WRITE|IN_DELETE_SELF;
-
-    uint32_t jobToEvents(const json::object & job) {
-        uint32_t events = EVENTS_BASE;
+    // the job removed: the background walk stops
+    std::atomic<bool> removed{false};
+    // the job modified: the late walk results go to the new runtime
+    std::shared_ptr<JobRuntime> modified;
+
+    // the control id, kept by the modified job
+    uint64_t id = 0;
+    // the source and the key in the sources table
+    std::string source;
+    std::string key;
+    // the watches are kept, the events are dropped
+    std::atomic<bool> paused{false};
+    std::atomic<uint64_t> pausedDropped{0};
+    // the watches of the job by id, the service lock
+    std::unordered_set<uint64_t> watches;
+};
 
-        if(job.contains("inotify") && job.at("inotify").is_array()) {
-            events = jsonArrayToEvents(job.at("inotify").as_array());
-        }
+using JobRuntimePtr = std::shared_ptr<JobRuntime>;
+// loaded jobs of the one source (config or job file), key: serialized job config
+using JobsSource = std::unordered_map<std::string, JobRuntimePtr>;
+// the path is valid for the call only, from: the old path of the paired rename
+using JobContinueEventCb = std::function<void(std::string_view, uint32_t, const JobRuntimePtr &, uint64_t, std::string_view)>;
 
-        return events;
-    }
-}
+class InotifyJob;
+// the watches by path, for the subtree rename
+using JobIndex = std::multimap<std::string, InotifyJob*>;
+using InotifyJobPtr = std::shared_ptr<InotifyJob>;
 
 class InotifyJob : public Inotify::Path {
-    json::object job_;
+    JobRuntimePtr runtime_;
     JobContinueEventCb continueEventCb_;
+    std::shared_ptr<Inotify::Snapshot> snapshot_;
+    std::shared_ptr<Inotify::Fanotify> fanotify_;
     uint32_t filter_ = 0;
-    bool debug_ = false;
+    bool polled_ = false;
+
+  protected:
+    // path / name in the thread buffer: without allocation in the steady state
+    static std::string_view joinPath(const std::filesystem::path & path, std::string_view name) {
+        thread_local std::string buf;
+        buf.assign(path.native());
+
+        if(name.size()) {
+            if(buf.empty() || buf.back() != '/') {
+                buf.push_back('/');
+            }
+
+            buf.append(name);
+        }
+
+        return buf;
+    }
+
+    void continueEvent(const std::filesystem::path & path, std::string_view name, uint32_t event) {
+        // the write is synced by its IN_CLOSE_WRITE
+        if(snapshot_ && (event & EVENTS_SNAPSHOT)) {
+            snapshot_->update(path, name, event);
+        }
+
+        if(filter_ & event) {
+            continueEventCb_(joinPath(path, name), event, runtime(), job_id(), {});
+        }
+    }
 
   public:
-    InotifyJob(boost::asio::io_context & ioc, const std::filesystem::path & path,
-        const json::object & json, uint32_t events, JobContinueEventCb && func)
-        : Inotify::Path(ioc, path, (events | IN_DELETE_SELF)), job_(json), continueEventCb_(std::move(func)) {
+    // the position in the job index, the service lock
+    JobIndex::iterator indexed;
+
+    // the events to keep the snapshot in sync, IN_MODIFY is too frequent
+    static const uint32_t EVENTS_SNAPSHOT = IN_CREATE|IN_DELETE|IN_MOVE|IN_CLOSE_WRITE|IN_ATTRIB;
+    // the recursive job follows the tree
+    static const uint32_t EVENTS_RECURSIVE = IN_CREATE|IN_DELETE|IN_MOVE;
+
+    InotifyJob(Inotify::Instance & inst, const std::filesystem::path & path, const JobRuntimePtr & runtime, JobContinueEventCb && func)
+        : Inotify::Path(inst, path, (runtime->desc->events | IN_DELETE_SELF), runtime->desc->filter, runtime->metrics), runtime_(runtime), continueEventCb_(std::move(func)) {
+
+        filter_ = (runtime->desc->events | IN_DELETE_SELF);
+
+        if(runtime->desc->overflowRescan) {
+            snapshot_ = std::make_shared<Inotify::Snapshot>();
+        }
+
+        if(runtime->desc->debug) {
+            changeFilterEvents(IN_ALL_EVENTS);
+        } else if(uint32_t extra = (snapshot_ ? EVENTS_SNAPSHOT : 0) | (runtime->desc->recursive ? EVENTS_RECURSIVE : 0)) {
+            // the snapshot sync, the created and the renamed subdirs are followed
+            changeFilterEvents(filter_ | extra);
+        }
+    }
+
+    // fanotify backend: the tree events are fed by the mark, without snapshot
+    // polled: over the watch budget, the events are synthesized by the periodic snapshot rescan
+    InotifyJob(asio::io_context & ioc, const std::filesystem::path & path, const JobRuntimePtr & runtime, JobContinueEventCb && func, bool polled = false)
+        : Inotify::Path(ioc, path, (runtime->desc->events | IN_DELETE_SELF), runtime->desc->filter, runtime->metrics), runtime_(runtime), continueEventCb_(std::move(func)),
+            polled_(polled) {
 
-        filter_ = (events | IN_DELETE_SELF);
-        debug_ = json.contains("debug") ? json::value_to<bool>(json.at("debug")) : false;
+        filter_ = (runtime->desc->events | IN_DELETE_SELF);
 
-        if(debug_) {
+        if(polled_) {
+            snapshot_ = std::make_shared<Inotify::Snapshot>();
+        }
+
+        if(runtime->desc->debug) {
             changeFilterEvents(IN_ALL_EVENTS);
+        } else if(polled_) {
+            changeFilterEvents(filter_ | EVENTS_SNAPSHOT | (runtime->desc->recursive ? EVENTS_RECURSIVE : 0));
         }
     }
 
-    const json::object & getConf(void) const {
-        return job_;
+    bool polled(void) const {
+        return polled_;
     }
 
-    void inOpenEvent(const std::filesystem::path & path, std::string name) override {
-        spdlog::debug("{}: path: {}, name: {}", __FUNCTION__, path.native(), name);
-        const uint32_t event = IN_OPEN;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
+    ~InotifyJob() {
+        if(fanotify_) {
+            fanotify_->stop();
         }
     }
 
-    void inCreateEvent(const std::filesystem::path & path, std::string name) override {
+    void startFanotify(void) {
+        auto desc = this->desc();
+        fanotify_ = std::make_shared<Inotify::Fanotify>(ioc_, path(), (desc->debug ? IN_ALL_EVENTS : filter_), desc->recursive, desc->fanotifyMount);
+        fanotify_->start(shared_from_this());
+    }
+
+    // swapped by the config reload
+    JobRuntimePtr runtime(void) const {
+        return std::atomic_load(& runtime_);
+    }
+
+    void setRuntime(const JobRuntimePtr & runtime) {
+        std::atomic_store(& runtime_, runtime);
+    }
+
+    Inotify::JobDescPtr desc(void) const {
+        return runtime()->desc;
+    }
+
+    std::shared_ptr<Inotify::Snapshot> snapshot(void) const {
+        return snapshot_;
+    }
+
+    void synthesizeEvents(const Inotify::SnapshotEvents & events) {
+        for(auto & [name, mask] : events) {
+            dispatchEvent(mask, name.c_str());
+        }
+    }
+
+    // the entry of the new dir found by the scan
+    void synthesizeCreate(const char* name, bool dir) {
+        dispatchEvent(IN_CREATE | (dir ? IN_ISDIR : 0), name);
+    }
+
+    void inOverflowEvent(const std::filesystem::path & path) override {
+        if(snapshot_) {
+            continueEventCb_(path.native(), IN_Q_OVERFLOW, runtime(), job_id(), {});
+        }
+    }
+
+    void inOpenEvent(const std::filesystem::path & path, std::string_view name) override {
         spdlog::debug("{}: path: {}, name: {}", __FUNCTION__, path.native(), name);
+        const uint32_t event = IN_OPEN;
+        continueEvent(path, name, event);
+    }
+
+    void inCreateEvent(const std::filesystem::path & path, std::string_view name, bool isdir) override {
+        spdlog::debug("{}: path: {}, name: {}, isdir: {}", __FUNCTION__, path.native(), name, isdir);
         const uint32_t event = IN_CREATE;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
+
+        if(snapshot_) {
+            snapshot_->update(path, name, event);
+        }
+
+        // the recursive job: the new subdirs are watched, IN_ISDIR without stat
+        if((filter_ & event) || desc()->recursive) {
+            continueEventCb_(joinPath(path, name), event | (isdir ? IN_ISDIR : 0), runtime(), job_id(), {});
         }
     }
 
-    void inAccessEvent(const std::filesystem::path & path, std::string name) override {
+    void inAccessEvent(const std::filesystem::path & path, std::string_view name) override {
         spdlog::debug("{}: path: {}, name: {}", __FUNCTION__, path.native(), name);
         const uint32_t event = IN_ACCESS;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
-        }
+        continueEvent(path, name, event);
     }
 
-    void inModifyEvent(const std::filesystem::path & path, std::string name) override {
+    void inModifyEvent(const std::filesystem::path & path, std::string_view name) override {
         spdlog::debug("{}: path: {}, name: {}", __FUNCTION__, path.native(), name);
         const uint32_t event = IN_MODIFY;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
-        }
+        continueEvent(path, name, event);
     }
 
-    void inAttribEvent(const std::filesystem::path & path, std::string name) override {
+    void inAttribEvent(const std::filesystem::path & path, std::string_view name) override {
         spdlog::debug("{}: path: {}, name: {}", __FUNCTION__, path.native(), name);
         const uint32_t event = IN_ATTRIB;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
-        }
+        continueEvent(path, name, event);
     }
 
-    void inMoveEvent(const std::filesystem::path & path, std::string name, bool self) override {
+    void inMoveEvent(const std::filesystem::path & path, std::string_view name, bool self) override {
         spdlog::debug("{}: path: {}, name: {}, self: {}", __FUNCTION__, path.native(), name, self);
         const uint32_t event = self ? IN_MOVE_SELF : IN_MOVE;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
+        continueEvent(path, name, event);
+    }
+
+    void inMovedEvent(const std::filesystem::path & path, std::string_view name, uint32_t mask) override {
+        spdlog::debug("{}: path: {}, name: {}, mask: {:#x}", __FUNCTION__, path.native(), name, mask);
+        const uint32_t event = mask & IN_MOVE;
+
+        if(snapshot_) {
+            snapshot_->update(path, name, event);
+        }
+
+        // the recursive job: the moved in dir is watched, the moved out entry of the new dir is forgotten
+        if((filter_ & event) || desc()->recursive) {
+            continueEventCb_(joinPath(path, name), mask, runtime(), job_id(), {});
         }
     }
 
-    void inCloseEvent(const std::filesystem::path & path, std::string name, bool write) override {
+    bool sameTree(const Inotify::Path & other) const override {
+        auto job = dynamic_cast<const InotifyJob*>(& other);
+        return job && job->runtime() == runtime();
+    }
+
+    void inRenameSourceEvent(const std::filesystem::path & path, std::string_view name) override {
+        if(snapshot_) {
+            snapshot_->update(path, name, IN_MOVED_FROM);
+        }
+    }
+
+    void inRenameEvent(const std::filesystem::path & path, std::string_view name, std::string_view from) override {
+        spdlog::debug("{}: path: {}, name: {}, from: {}", __FUNCTION__, path.native(), name, from);
+
+        if(snapshot_) {
+            snapshot_->update(path, name, IN_MOVED_TO);
+        }
+
+        // the source half as unpaired: the IN_MOVED_FROM jobs get the old path, the recursive job forgets it
+        if((filter_ & IN_MOVED_FROM) || desc()->recursive) {
+            continueEventCb_(from, IN_MOVED_FROM, runtime(), job_id(), {});
+        }
+
+        // the recursive job: the watches of the renamed subdir are retargeted
+        if((filter_ & IN_MOVED_TO) || desc()->recursive) {
+            continueEventCb_(joinPath(path, name), IN_MOVED_TO, runtime(), job_id(), from);
+        }
+    }
+
+    void inCloseEvent(const std::filesystem::path & path, std::string_view name, bool write) override {
         spdlog::debug("{}: path: {}, name: {}, write: {}", __FUNCTION__, path.native(), name, write);
 
-        if(job_.contains("name")) {
-            if(name != json::value_to<std::string>(job_["name"])) {
-                return;
-            }
+        if(snapshot_ && write) {
+            snapshot_->update(path, name, IN_CLOSE_WRITE);
+        }
+
+        if(auto desc = this->desc(); desc->name.size() && name != desc->name) {
+            return;
         }
 
         const uint32_t event = write ? IN_CLOSE_WRITE : IN_CLOSE_NOWRITE;
-        if(!debug_ || (filter_ & event)) {
-            continueEventCb_(name.size() ? path / name : path, event, job_, job_id());
+        if(filter_ & event) {
+            continueEventCb_(joinPath(path, name), event, runtime(), job_id(), {});
         }
     }
 
-    void inDeleteEvent(const std::filesystem::path & path, std::string name, bool self) override {
+    void inDeleteEvent(const std::filesystem::path & path, std::string_view name, bool self) override {
         if(self) {
             spdlog::warn("{}: path: {}, name: {}, self: {}", __FUNCTION__, path.native(), name, self);
             cancelAsync();
@@ -150,10 +352,14 @@ class InotifyJob : public Inotify::Path {
             spdlog::debug("{}: path: {}, name: {}, self: {}", __FUNCTION__, path.native(), name, self);
         }
 
+        if(snapshot_ && ! self) {
+            snapshot_->update(path, name, IN_DELETE);
+        }
+
         const uint32_t event = self ? IN_DELETE_SELF : IN_DELETE;
-        if(!debug_ || (filter_ & event)) {
-            // background
-            asio::post(ioc_, std::bind(continueEventCb_, name.size() ? path / name : path, event, job_, job_id()));
+        // the strand order: the job self delete is safe, the drain holds the watch
+        if((filter_ & event) || (! self && desc()->recursive)) {
+            continueEventCb_(joinPath(path, name), event, runtime(), job_id(), {});
         }
     }
 };
@@ -163,20 +369,20 @@ class InotifyConfFile : public Inotify::Path {
     ConfFileModifyEventCb confFileModifyEventCb_;
 
   public:
-    InotifyConfFile(boost::asio::io_context & ioc, const std::filesystem::path & conf_path, ConfFileModifyEventCb && func)
-        : Inotify::Path(ioc, conf_path.parent_path(), IN_CLOSE_WRITE|IN_DELETE|IN_DELETE_SELF),
+    InotifyConfFile(Inotify::Instance & inst, const std::filesystem::path & conf_path, ConfFileModifyEventCb && func)
+        : Inotify::Path(inst, conf_path.parent_path(), IN_CLOSE_WRITE|IN_DELETE|IN_DELETE_SELF),
             filename_(conf_path.filename()), confFileModifyEventCb_(std::move(func)) {
     }
 
-    void inCloseEvent(const std::filesystem::path & path, std::string name, bool write) override {
+    void inCloseEvent(const std::filesystem::path & path, std::string_view name, bool write) override {
         assert(write);
-        if(name == filename_) {
+        if(name == filename_.native()) {
             confFileModifyEventCb_(path / name);
         }
     }
 
-    void inDeleteEvent(const std::filesystem::path & path, std::string name, bool self) override {
-        if(self || name == filename_) {
+    void inDeleteEvent(const std::filesystem::path & path, std::string_view name, bool self) override {
+        if(self || name == filename_.native()) {
             spdlog::warn("{}: path: {}, name: {}, self: {}", __FUNCTION__, path.native(), name, self);
             cancelAsync();
         }
@@ -187,23 +393,23 @@ class InotifyConfDir : public Inotify::Path {
     ConfDirModifyEventCb confDirModifyEventCb_;
 
   public:
-    InotifyConfDir(boost::asio::io_context & ioc, const std::filesystem::path & dir_path, ConfDirModifyEventCb && func)
-        : Inotify::Path(ioc, dir_path, IN_CLOSE_WRITE|IN_DELETE|IN_DELETE_SELF),
+    InotifyConfDir(Inotify::Instance & inst, const std::filesystem::path & dir_path, ConfDirModifyEventCb && func)
+        : Inotify::Path(inst, dir_path, IN_CLOSE_WRITE|IN_DELETE|IN_DELETE_SELF),
             confDirModifyEventCb_(std::move(func)) {
     }
 
-    void inCloseEvent(const std::filesystem::path & path, std::string name, bool write) override {
+    void inCloseEvent(const std::filesystem::path & path, std::string_view name, bool write) override {
         assert(write);
-        confDirModifyEventCb_(path / name, IN_CLOSE_WRITE, job_id());
+        confDirModifyEventCb_(path / name, IN_CLOSE_WRITE);
     }
 
-    void inDeleteEvent(const std::filesystem::path & path, std::string name, bool self) override {
+    void inDeleteEvent(const std::filesystem::path & path, std::string_view name, bool self) override {
         if(self) {
             spdlog::warn("{}: path: {}, name: {}, self: {}", __FUNCTION__, path.native(), name, self);
             cancelAsync();
         } else {
             assert(name.size());
-            confDirModifyEventCb_(path / name, IN_DELETE, job_id());
+            confDirModifyEventCb_(path / name, IN_DELETE);
         }
     }
 };
@@ -215,294 +421,1423 @@ class ServiceWatcher : private boost::noncopyable {
 
     const std::filesystem::path jobs_dir_;
 
+    // the io_uring engine, shared by the instances: destroyed after them
+    std::unique_ptr<Inotify::Uring> uring_;
+    // the openat and statx of the snapshot rescans, the rescan thread only: destroyed after it
+    std::unique_ptr<Inotify::UringScan> scanRing_;
+    std::vector<std::unique_ptr<Inotify::Instance>> instances_;
+    System::ProcessReaper reaper_;
+    System::CommandExecutor executor_;
+
     mutable std::mutex lock_;
-    std::list<InotifyPathPtr> jobs_;
+    // the watches by id
+    std::unordered_map<uint64_t, InotifyJobPtr> jobs_;
+    JobIndex index_;
+
+    // the jobs by source, for the incremental reload
+    std::unordered_map<std::string, JobsSource> sources_;
+    // the jobs by control id, conf strand
+    std::unordered_map<uint64_t, JobRuntimePtr> runtimes_;
+    uint64_t runtimeSeq_ = 0;
+
+    std::shared_ptr<InotifyConfFile> conf_job_;
+    std::shared_ptr<InotifyConfDir> dir_jobs_;
+
+    // the config and the jobs table changes are serialized
+    asio::strand<asio::io_context::executor_type> conf_strand_;
+    size_t threads_ = 4;
 
-    std::unique_ptr<InotifyConfFile> conf_job_;
-    std::unique_ptr<InotifyConfDir> dir_jobs_;
+    // the prometheus textfile, conf strand
+    asio::steady_timer metrics_timer_;
+    std::filesystem::path metrics_file_;
+    std::chrono::seconds metrics_interval_{10};
+
+    // the inotify watches of the jobs, the dirs over it are polled
+    Inotify::WatchBudget budget_;
+    asio::steady_timer poll_timer_;
+    std::chrono::seconds poll_interval_{30};
+
+    // the dispatched events of the journaled jobs, opened once
+    Inotify::JournalPtr journal_;
+
+    // the jobs added by the control socket
+    const std::string CONTROL_SOURCE{":control"};
+    std::unique_ptr<Inotify::ControlServer> control_;
+
+    // destroyed first: the rescan thread looks up the jobs
+    Inotify::RescanScheduler rescan_;
+
+    // the skip_unchanged jobs content hash
+    std::unique_ptr<asio::thread_pool> hasher_;
+    // the in-process job actions
+    std::unique_ptr<asio::thread_pool> actions_;
+
+    // the recursive jobs tree walks
+    asio::thread_pool walker_{1};
+    size_t walk_threads_ = 4;
+    std::atomic<bool> shutdown_{false};
 
   protected:
-    void confFileModifyEvent(const std::filesystem::path & path) {
-        readConfig(path);
+    Inotify::Instance & instance(const std::filesystem::path & path) {
+        return *instances_[std::hash<std::string>{}(path.native()) % instances_.size()];
     }
 
-    void confDirModifyEvent(const std::filesystem::path & path, uint32_t event, uint64_t job_id) {
-        if(IN_CLOSE_WRITE == event || IN_DELETE == event) {
-            std::scoped_lock guard{ lock_ };
-            // job delete
-            if(auto it = std::find_if(jobs_.begin(), jobs_.end(),
-                [job_id](auto & ptr){ return ptr->job_id() == job_id; }); it != jobs_.end()) {
-                spdlog::info("{}: remove job, id: {:016x}, path: {}", __FUNCTION__, (*it)->job_id(), (*it)->path().native());
-                jobs_.erase(it);
+    void waitSignals(void) {
+        signals_.async_wait([this](const system::error_code & ec, int signal) {
+            if(ec) {
+                return;
             }
-        }
 
-        if(IN_CLOSE_WRITE == event) {
-            // job add
-            loadFileJob(path);
-        }
+            if(signal == SIGINT || signal == SIGTERM) {
+                this->ioc_.stop();
+                return;
+            }
+
+            asio::post(this->conf_strand_, std::bind(& ServiceWatcher::status, this));
+            // the next SIGUSR1
+            this->waitSignals();
+        });
     }
 
-    void jobContinueEvent(const std::filesystem::path & path, uint32_t event, const json::object & job_conf, uint64_t job_id) {
-        if(! job_conf.contains("command")) {
-            return;
+    void writeMetrics(void) {
+        if(! metrics_file_.empty()) {
+            Inotify::metrics().writeTextfile(metrics_file_);
         }
 
-        spdlog::debug("{}: event: {}", __FUNCTION__, Inotify::maskToName(event));
-
-        if( Inotify::jobToEvents(job_conf) & event ) {
-            auto cmd = json::value_to<std::string>(job_conf.at("command"));
-            auto owner = job_conf.contains("owner") ? json::value_to<std::string>(job_conf.at("owner")) : std::string{};
-            auto escaped = job_conf.contains("escaped") ? json::value_to<bool>(job_conf.at("escaped")) : false;
-            std::list<std::string> args = { std::string(Inotify::maskToName(event)), String::quoted(path.native(), escaped) };
+        metrics_timer_.expires_after(metrics_interval_);
+        metrics_timer_.async_wait([this](const system::error_code & ec) {
+            if(! ec) {
+                this->writeMetrics();
+            }
+        });
+    }
 
-            spdlog::info("{}: run cmd: {}, args: [{}]", __FUNCTION__, cmd, boost::algorithm::join(args, ","));
-            asio::post(ioc_, std::bind(&System::runCommand, std::move(cmd), std::move(args), std::move(owner)));
-        }
+    /// the polled dirs are rescanned by the rescan thread, rate limited
+    void pollJobs(void) {
+        std::vector<uint64_t> polled;
 
-        if(IN_DELETE_SELF == event) {
+        {
             std::scoped_lock guard{ lock_ };
-            // job self delete
-            if(auto it = std::find_if(jobs_.begin(), jobs_.end(),
-                [job_id](auto & ptr){ return ptr->job_id() == job_id; }); it != jobs_.end()) {
-                spdlog::info("{}: remove job, id: {:016x}, path: {}", __FUNCTION__, (*it)->job_id(), (*it)->path().native());
-                jobs_.erase(it);
+
+            for(auto & [job_id, ptr] : jobs_) {
+                if(ptr->polled()) {
+                    polled.push_back(job_id);
+                }
             }
         }
 
-        if(IN_CREATE == event) {
-            bool recurse = job_conf.contains("recursive") ? json::value_to<bool>(job_conf.at("recursive")) : false;
-            if(std::filesystem::is_directory(path) && recurse) {
-                auto new_conf = job_conf;
-                new_conf["path"] = path.native();
-
-                auto jobContinueEventCb = std::bind(&ServiceWatcher::jobContinueEvent, this,
-                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+        for(auto job_id : polled) {
+            rescan_.schedule(job_id, true);
+        }
 
-                std::scoped_lock guard{ lock_ };
-                auto ptr = std::make_unique<InotifyJob>(ioc_, path, std::move(new_conf), Inotify::jobToEvents(new_conf), jobContinueEventCb);
-                spdlog::info("{}: add job, id: {:016x}, path: {}", __FUNCTION__, ptr->job_id(), ptr->path().native());
-                jobs_.emplace_back(std::move(ptr));
+        poll_timer_.expires_after(poll_interval_);
+        poll_timer_.async_wait([this](const system::error_code & ec) {
+            if(! ec) {
+                this->pollJobs();
             }
-        }
+        });
     }
 
-    void readConfig(const std::filesystem::path & path) {
-        std::ifstream ifs{path};
+    /// the control socket thread: the jobs table is changed on the conf strand
+    void controlRequest(std::string && line, Inotify::ControlReplyCb && reply) {
+        asio::post(conf_strand_, [this, line = std::move(line), reply = std::move(reply)]() {
+            reply(json::serialize(this->controlCommand(line)));
+        });
+    }
+
+    static json::object controlError(std::string_view error) {
+        return json::object{ { "ok", false }, { "error", error } };
+    }
+
+    /// the JSON line: {"cmd":"add","job":{...}}, {"cmd":"remove|pause|resume","id":N}, {"cmd":"list"}, {"cmd":"stats"[,"id":N]}
+    json::object controlCommand(const std::string & line) {
         system::error_code ec;
-        auto json = json::parse(std::string{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()}, ec);
+        auto req = json::parse(line, ec);
 
-        if(ec) {
-            spdlog::error("{}: {} error, code: {}, message: {}", __FUNCTION__, "json", ec.value(), ec.message());
-            return;
+        if(ec || ! req.is_object()) {
+            return controlError("json");
         }
 
-        if(! json.is_object()) {
-            spdlog::error("{}: {} failed, not object", __FUNCTION__, "json");
-            return;
+        auto & jo = req.get_object();
+        auto cmd = jo.contains("cmd") && jo["cmd"].is_string() ? std::string(jo["cmd"].get_string()) : std::string{};
+
+        if(cmd == "add") {
+            return controlAdd(jo);
         }
 
-        conf_ = json.as_object();
+        if(cmd == "list") {
+            return controlList();
+        }
 
-        bool debug = conf_.contains("debug") ? json::value_to<bool>(conf_["debug"]) : false;
-        spdlog::set_level(debug ? spdlog::level::debug : spdlog::level::info);
+        JobRuntimePtr runtime;
 
-        if(conf_.contains("jobs") && conf_["jobs"].is_array()) {
-            asio::post(ioc_, std::bind(& ServiceWatcher::loadAllJobs, this));
-        } else {
-            spdlog::warn("{}: config jobs empty", __FUNCTION__);
-        }
+        if(auto id = jo.if_contains("id")) {
+            auto job_id = id->to_number<uint64_t>(ec);
 
-        spdlog::info("{}: success", __FUNCTION__);
-    }
+            if(auto it = runtimes_.find(job_id); ! ec && it != runtimes_.end()) {
+                runtime = it->second;
+            } else {
+                return controlError("id");
+            }
+        }
 
-    void loadAllJobs(void) {
-        // clear jobs
-        {
-            std::scoped_lock guard{ lock_ };
-            jobs_.clear();
+        if(cmd == "stats") {
+            return controlStats(runtime);
         }
 
-        loadConfigJobs();
-        loadDirJobs();
-    }
+        if(cmd != "remove" && cmd != "pause" && cmd != "resume") {
+            return controlError("cmd");
+        }
 
-    void loadFileJob(const std::filesystem::path & file) {
-        if(file.extension() != ".job") {
-            spdlog::debug("{}: skipped job: {}", __FUNCTION__, file.native());
-            return;
+        if(! runtime) {
+            return controlError("id");
         }
 
-        std::ifstream ifs{file};
-        system::error_code ec;
-        auto json = json::parse(std::string{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()}, ec);
+        if(cmd == "remove") {
+            // the config and the jobs.d jobs are added back by the next reload of the file
+            if(runtime->source != CONTROL_SOURCE) {
+                return controlError("source");
+            }
 
-        if(ec) {
-            spdlog::warn("{}: {} error, code: {}, message: {}", __FUNCTION__, "json", ec.value(), ec.message());
-            return;
-        }
+            if(auto it = sources_.find(runtime->source); it != sources_.end()) {
+                it->second.erase(runtime->key);
 
-        if(! json.is_object()) {
-            spdlog::warn("{}: {} failed, not object", __FUNCTION__, "json");
-            return;
+                if(it->second.empty()) {
+                    sources_.erase(it);
+                }
+            }
+
+            jobRemove(runtime);
+            runtimes_.erase(runtime->id);
+        } else {
+            runtime->paused = (cmd == "pause");
+            spdlog::info("{}: job: {}, path: {}, paused: {}", __FUNCTION__, runtime->id, runtime->desc->path.native(), runtime->paused.load());
         }
 
-        loadJob(json.get_object());
+        return json::object{ { "ok", true }, { "id", runtime->id } };
     }
 
-    void loadDirJobs(void) {
-        for(const auto & file: System::readDir(jobs_dir_, false, ReadDirFilter::File)) {
-            loadFileJob(file);
+    json::object controlAdd(json::object & jo) {
+        auto job = jo.if_contains("job");
+
+        if(! job || ! job->is_object()) {
+            return controlError("job");
         }
-    }
 
-    void loadConfigJobs(void) {
-        for(auto & json : conf_["jobs"].get_array()) {
-            if(! json.is_object()) {
-                spdlog::warn("{}: job skipped, not object", __FUNCTION__);
-            }
+        auto key = json::serialize(*job);
+        auto & source = sources_[CONTROL_SOURCE];
 
-            loadJob(json.get_object());
+        // the same config: the loaded job
+        if(auto it = source.find(key); it != source.end()) {
+            return json::object{ { "ok", true }, { "id", it->second->id }, { "exists", true } };
         }
-    }
 
-    void loadJob(const json::object & job_conf) {
+        auto desc = Inotify::compileJob(job->get_object());
+        auto runtime = desc ? loadJob(desc) : nullptr;
 
-        if(! job_conf.contains("path") || ! job_conf.at("path").is_string()) {
-            spdlog::warn("{}: job skipped, tag not found: {}", __FUNCTION__, "path");
-            return;
+        if(! runtime) {
+            if(source.empty()) {
+                sources_.erase(CONTROL_SOURCE);
+            }
+
+            return controlError(desc ? "path" : "job");
         }
 
-        auto path = std::filesystem::path{job_conf.at("path").get_string().c_str()};
-        const uint32_t events = Inotify::jobToEvents(job_conf);
+        jobAttach(runtime, CONTROL_SOURCE, key);
+        source.emplace(std::move(key), runtime);
 
-        auto jobContinueEventCb = std::bind(&ServiceWatcher::jobContinueEvent, this,
-                    std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4);
+        return json::object{ { "ok", true }, { "id", runtime->id } };
+    }
 
-        if(std::filesystem::is_regular_file(path)) {
+    json::object controlList(void) const {
+        json::array jobs;
+        std::scoped_lock guard{ lock_ };
 
-            if(events == Inotify::EVENTS_BASE) {
-                auto new_conf = job_conf;
-                new_conf["name"] = path.filename().native();
-                auto ptr = std::make_unique<InotifyJob>(ioc_, path.parent_path(), new_conf, events, std::move(jobContinueEventCb));
-                spdlog::info("{}: add job, id: {:016x}, path: {}, name: {}", __FUNCTION__, ptr->job_id(), path.parent_path().native(), path.filename().native());
-                std::scoped_lock guard{ lock_ };
-                jobs_.emplace_back(std::move(ptr));
-            } else {
-                auto ptr = std::make_unique<InotifyJob>(ioc_, path, job_conf, events, std::move(jobContinueEventCb));
-                spdlog::info("{}: add job, id: {:016x}, path: {}", __FUNCTION__, ptr->job_id(), path.native());
-                std::scoped_lock guard{ lock_ };
-                jobs_.emplace_back(std::move(ptr));
-            }
-
-        } else if(std::filesystem::is_directory(path)) {
-            bool recurse = job_conf.contains("recursive") ? json::value_to<bool>(job_conf.at("recursive")) : false;
-
-            if(recurse) {
-                auto dirs = System::readDir(path, recurse, ReadDirFilter::Dir);
-                for(const auto & dir : dirs) {
-                    auto ptr = std::make_unique<InotifyJob>(ioc_, dir, job_conf, events, std::move(jobContinueEventCb));
-                    spdlog::info("{}: add job, id: {:016x}, path: {}", __FUNCTION__, ptr->job_id(), dir);
-                    std::scoped_lock guard{ lock_ };
-                    jobs_.emplace_back(std::move(ptr));
-                }
-            } else {
-                auto ptr = std::make_unique<InotifyJob>(ioc_, path, job_conf, events, std::move(jobContinueEventCb));
-                spdlog::info("{}: add job, id: {:016x}, path: {}", __FUNCTION__, ptr->job_id(), path.native());
-                std::scoped_lock guard{ lock_ };
-                jobs_.emplace_back(std::move(ptr));
-            }
-        } else {
-            spdlog::warn("{}: job skipped, path not found: {}", __FUNCTION__, path.native());
+        for(const auto & [id, runtime] : runtimes_) {
+            auto & desc = *runtime->desc;
+            auto [watches, polled] = jobUsage(*runtime);
+
+            jobs.emplace_back(json::object{
+                { "id", id }, { "source", runtime->source }, { "path", desc.path.native() }, { "command", desc.command },
+                { "action", desc.actionType },
+                { "recursive", desc.recursive }, { "backend", desc.fanotify ? "fanotify" : "inotify" }, { "priority", desc.priority },
+                { "watches", watches }, { "polled", polled }, { "paused", runtime->paused.load() } });
         }
+
+        return json::object{ { "ok", true }, { "jobs", std::move(jobs) } };
     }
 
-  public:
-    ServiceWatcher(boost::asio::io_context & ioc, const std::filesystem::path & conf_path, const std::filesystem::path & jobs_dir)
-        : ioc_(ioc), signals_(ioc), jobs_dir_(jobs_dir) {
-        spdlog::info("found config: {}", conf_path.native());
-        readConfig(conf_path);
+    json::object controlStats(const JobRuntimePtr & runtime) const {
+        auto & metrics = Inotify::metrics();
 
-        conf_job_ = std::make_unique<InotifyConfFile>(ioc_, conf_path, std::bind(&ServiceWatcher::confFileModifyEvent, this, std::placeholders::_1));
+        if(! runtime) {
+            std::scoped_lock guard{ lock_ };
 
-        if(std::filesystem::is_directory(jobs_dir)) {
-            dir_jobs_ = std::make_unique<InotifyConfDir>(ioc_, jobs_dir, std::bind(&ServiceWatcher::confDirModifyEvent, this,
-                                                            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            return json::object{ { "ok", true }, { "jobs", runtimes_.size() }, { "watches", jobs_.size() },
+                { "watches_used", metrics.watchesUsed.load() }, { "watches_limit", metrics.watchesLimit.load() },
+                { "watches_polled", metrics.watchesPolled.load() }, { "watches_evicted", metrics.watchesEvicted.load() },
+                { "running", reaper_.countRunning() }, { "overflows", metrics.overflows.load() } };
         }
 
-        signals_.add(SIGINT);
-        signals_.add(SIGTERM);
-        signals_.add(SIGUSR1);
+        auto & jm = *runtime->metrics;
+        auto sum = [](const std::array<Inotify::Counter, Inotify::EVENT_TYPES> & counters) {
+            uint64_t res = 0;
 
-        signals_.async_wait([this](const system::error_code & ec, int signal) {
-            if(signal == SIGINT || signal == SIGTERM) {
-                this->ioc_.stop();
-            } else {
-                this->status();
+            for(auto & counter : counters) {
+                res += counter.load(std::memory_order_relaxed);
             }
-        });
-    }
 
-    void status(void) const {
-        std::scoped_lock guard{ lock_ };
-        spdlog::info("{}: jobs count: {}", __FUNCTION__, jobs_.size());
+            return res;
+        };
 
-        for(const auto & job: jobs_) {
-            if(auto ptr = dynamic_cast<InotifyJob*>(job.get())) {
-                auto & conf = ptr->getConf();
-                auto path = json::value_to<std::string>(conf.at("path"));
-                auto cmd = json::value_to<std::string>(conf.at("command"));
-                spdlog::info("{}: job id: {:016x}, path: {}, cmd: {}", __FUNCTION__, ptr->job_id(), path, cmd);
-            }
-        }
+        std::scoped_lock guard{ lock_ };
+        auto [watches, polled] = jobUsage(*runtime);
+
+        return json::object{ { "ok", true }, { "id", runtime->id }, { "path", runtime->desc->path.native() },
+            { "watches", watches }, { "polled", polled }, { "paused", runtime->paused.load() }, { "paused_dropped", runtime->pausedDropped.load() },
+            { "received", sum(jm.received) }, { "filtered", sum(jm.filtered) }, { "dispatched", sum(jm.dispatched) },
+            { "spawned", jm.spawned.load() }, { "failed", jm.failed.load() }, { "dropped", jm.dropped.load() },
+            { "shed", jm.shed.load() }, { "coalesced", jm.coalesced.load() }, { "deferred", jm.deferred.load() }, { "unchanged", jm.unchanged.load() },
+            { "actions", jm.actions.load() }, { "actions_failed", jm.actionsFailed.load() }, { "actions_dropped", jm.actionsDropped.load() } };
     }
-};
-
-int main(int argc, char** argv) {
 
-    const char* conf_path = "/etc/inotify_watcher/config.json";
-    const char* jobs_dir = "/etc/inotify_watcher/jobs.d";
+    void confFileModifyEvent(const std::filesystem::path & path) {
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::readConfig, this, path));
+    }
 
-    if(auto env = getenv("INOTIFY_SERVICE_CONF")) {
-        conf_path = env;
+    void confDirModifyEvent(const std::filesystem::path & path, uint32_t event) {
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::confDirChanged, this, path, event));
     }
 
-    if(auto env = getenv("INOTIFY_JOBS_DIR")) {
-        jobs_dir = env;
+    void confDirChanged(const std::filesystem::path & path, uint32_t event) {
+        if(IN_CLOSE_WRITE == event) {
+            // job add or modify
+            loadFileJob(path);
+        } else if(IN_DELETE == event && sources_.count(path.native())) {
+            // job delete
+            syncJobs(path.native(), {});
+        }
     }
 
-    if(1 < argc) {
-        if(0 == strcmp(argv[1], "--help")) {
-            std::cout << "usage: " << argv[0] << " --config <json config>" << std::endl;
-            return EXIT_SUCCESS;
+    void jobRunCommand(std::string_view path, uint32_t mask, const JobRuntime* runtime, uint64_t seq, bool low, std::string_view from) {
+        auto & desc = *runtime->desc;
+        System::Command command{desc.command, { Inotify::maskToString(mask), String::quoted(path, desc.escaped) }, desc.owner};
+
+        if(from.size()) {
+            // the rename: IN_MOVED_TO new old
+            command.args.emplace_back(String::quoted(from, desc.escaped));
         }
 
-        if(0 == strcmp(argv[1], "--config")) {
-            conf_path = argv[2];
+        if(seq) {
+            // the failed command is replayed after the restart
+            command.done = [journal = journal_, seq](bool success) {
+                if(success) {
+                    journal->ack(seq);
+                }
+            };
         }
-    }
 
-    if(! std::filesystem::is_regular_file(conf_path)) {
-        std::cerr << "config not found: " << conf_path << std::endl;
-        std::cout << "usage: " << argv[0] << " --config <json config>" << std::endl;
-        return EXIT_FAILURE;
+        executor_.submit(runtime->group, std::move(command), low);
     }
 
-    auto sink = std::make_shared<spdlog::sinks::systemd_sink_mt>();
-    auto logger = std::make_shared<spdlog::logger>("inotify_watcher", sink);
-
-    spdlog::register_logger(logger);
-    spdlog::set_default_logger(logger);
+    void jobRunBatch(Inotify::BatchEvents && events, const JobRuntime* runtime) {
+        auto & desc = *runtime->desc;
+        System::Command command{desc.command, {}, desc.owner};
 
-    spdlog::set_pattern("%v");
-    spdlog::set_level(spdlog::level::info);
+        if(desc.batchStdin) {
+            // records: "EVENT path\n", or "EVENT path\0" with raw path
+            bool nul = desc.batchDelimiter == '\0';
 
-    asio::io_context ctx{4};
+            auto record = [&](uint32_t mask, const std::string & path) {
+                command.input.append(Inotify::maskToString(mask)).append(" ");
+                command.input.append(nul ? path : String::quoted(path, desc.escaped));
+                command.input.push_back(desc.batchDelimiter);
+            };
 
-    try {
-        auto app = std::make_unique<ServiceWatcher>(ctx, conf_path, jobs_dir);
+            // the rename: the IN_MOVED_FROM half is the separate event
+            for(auto & ev : events) {
+                record(ev.mask, ev.path.native());
+            }
+        } else {
+            // pairs: EVENT path EVENT path ...
+            auto record = [&](uint32_t mask, const std::string & path) {
+                command.args.emplace_back(Inotify::maskToString(mask));
+                command.args.emplace_back(String::quoted(path, desc.escaped));
+            };
+
+            for(auto & ev : events) {
+                record(ev.mask, ev.path.native());
+            }
+        }
+
+        std::vector<uint64_t> seqs;
+
+        for(auto & ev : events) {
+            if(ev.seq) {
+                seqs.push_back(ev.seq);
+            }
+        }
+
+        if(seqs.size()) {
+            command.done = [journal = journal_, seqs = std::move(seqs)](bool success) {
+                if(success) {
+                    for(auto seq : seqs) {
+                        journal->ack(seq);
+                    }
+                }
+            };
+        }
+
+        executor_.submit(runtime->group, std::move(command));
+    }
+
+    /// the new event after the debounce, from: the old path of the rename
+    void jobDispatch(std::string_view path, uint32_t mask, JobRuntime* runtime, std::string_view from = {}) {
+        if(runtime->unchanged) {
+            // the hash pool, back to jobAdmit
+            runtime->unchanged->push(path, mask, from);
+        } else {
+            jobAdmit(path, mask, runtime, from);
+        }
+    }
+
+    void jobAdmit(std::string_view path, uint32_t mask, JobRuntime* runtime, std::string_view from) {
+        bool low = false;
+
+        if(runtime->limiter) {
+            auto verdict = runtime->limiter->admit(path, mask, from);
+
+            if(verdict == Inotify::RateVerdict::Shed) {
+                return;
+            }
+
+            low = verdict == Inotify::RateVerdict::Deferred;
+        }
+
+        jobDeliver(path, mask, runtime, 0, low, from);
+    }
+
+    /// seq: the replayed record, 0: the new event
+    /// low: the exec command is deferred, the worker and the batch jobs spawn no command per event
+    void jobDeliver(std::string_view path, uint32_t mask, JobRuntime* runtime, uint64_t seq, bool low, std::string_view from = {}) {
+        // after the debounce: the merged event is recorded
+        if(! seq && journal_ && runtime->desc->journal) {
+            seq = journal_->append(runtime->desc->journalId, path, mask, from);
+        }
+
+        if(runtime->action) {
+            runtime->action->push(path, mask, seq, from);
+        } else if(runtime->worker) {
+            runtime->worker->push(path, mask, seq, from);
+        } else if(runtime->batcher) {
+            runtime->batcher->push(std::filesystem::path{path}, mask, seq, from);
+        } else {
+            jobRunCommand(path, mask, runtime, seq, low, from);
+        }
+    }
+
+    /// the unacknowledged records of the previous run, after the initial jobs load
+    void journalReplay(void) {
+        auto entries = journal_->takeRecovered();
+
+        if(entries.empty()) {
+            return;
+        }
+
+        std::unordered_map<uint64_t, JobRuntime*> runtimes;
+
+        for(const auto & [source, jobs] : sources_) {
+            for(const auto & [key, runtime] : jobs) {
+                if(runtime->desc->journal) {
+                    runtimes.emplace(runtime->desc->journalId, runtime.get());
+                }
+            }
+        }
+
+        size_t replayed = 0;
+
+        for(auto & entry : entries) {
+            if(auto it = runtimes.find(entry.job); it != runtimes.end()) {
+                jobDeliver(entry.path, entry.mask, it->second, entry.seq, false, entry.from);
+                replayed++;
+            } else {
+                // the job removed or changed
+                journal_->ack(entry.seq);
+            }
+        }
+
+        spdlog::info("{}: replayed: {}, skipped: {}", __FUNCTION__, replayed, entries.size() - replayed);
+    }
+
+    void jobRescan(uint64_t job_id, bool synthesize) {
+        std::shared_ptr<Inotify::Snapshot> snapshot;
+        std::filesystem::path path;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            if(auto it = jobs_.find(job_id); it != jobs_.end()) {
+                snapshot = it->second->snapshot();
+                path = it->second->path();
+            }
+        }
+
+        if(! snapshot) {
+            return;
+        }
+
+        // rescan thread, without lock
+        auto events = snapshot->rescan(path, synthesize, scanRing_.get());
+
+        if(events.empty()) {
+            return;
+        }
+
+        spdlog::info("{}: job id: {:016x}, path: {}, synthesized events: {}", __FUNCTION__, job_id, path.native(), events.size());
+
+        asio::post(ioc_, [this, job_id, events = std::move(events)]() {
+            std::scoped_lock guard{ lock_ };
+
+            if(auto it = jobs_.find(job_id); it != jobs_.end()) {
+                // only posted to the job handlers
+                it->second->synthesizeEvents(events);
+            }
+        });
+    }
+
+    void jobRegister(std::shared_ptr<InotifyJob> ptr) {
+        if(ptr->snapshot()) {
+            // the initial snapshot
+            rescan_.schedule(ptr->job_id(), false);
+        }
+
+        std::scoped_lock guard{ lock_ };
+        jobInsert(std::move(ptr));
+    }
+
+    /// the lock is held: the watch in the tables
+    void jobInsert(InotifyJobPtr ptr) {
+        ptr->indexed = index_.emplace(ptr->path().native(), ptr.get());
+        ptr->runtime()->watches.insert(ptr->job_id());
+        jobs_.emplace(ptr->job_id(), std::move(ptr));
+    }
+
+    /// the lock is held: the watch removed from the tables and the budget
+    void jobErase(std::unordered_map<uint64_t, InotifyJobPtr>::iterator it) {
+        auto & ptr = it->second;
+        index_.erase(ptr->indexed);
+        ptr->runtime()->watches.erase(ptr->job_id());
+
+        if(ptr->polled()) {
+            Inotify::metrics().watchesPolled.fetch_sub(1, std::memory_order_relaxed);
+        } else {
+            budget_.release(ptr->job_id());
+        }
+
+        jobs_.erase(it);
+    }
+
+    /// the lock is held: the watched and the polled dirs of the job
+    std::pair<size_t, size_t> jobUsage(const JobRuntime & runtime) const {
+        size_t polled = 0;
+
+        for(auto job_id : runtime.watches) {
+            if(auto it = jobs_.find(job_id); it != jobs_.end() && it->second->polled()) {
+                polled++;
+            }
+        }
+
+        return { runtime.watches.size() - polled, polled };
+    }
+
+    /// the subdir levels below the job path
+    static size_t jobDepth(std::string_view dir, const Inotify::JobDesc & desc) {
+        auto & root = desc.path.native();
+        size_t len = root.size() && root.back() == '/' ? root.size() - 1 : root.size();
+        return dir.size() > len + 1 ? std::count(dir.begin() + len, dir.end(), '/') : 0;
+    }
+
+    /// the lock is held: the dir without the watch is polled
+    std::shared_ptr<InotifyJob> jobMakePolled(const std::string & dir, const JobRuntimePtr & runtime) {
+        auto jobContinueEventCb = std::bind(&ServiceWatcher::jobContinueEvent, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5);
+
+        auto ptr = std::make_shared<InotifyJob>(ioc_, dir, runtime, jobContinueEventCb, true);
+        Inotify::metrics().watchesPolled.fetch_add(1, std::memory_order_relaxed);
+        return ptr;
+    }
+
+    /// the lock is held: the evicted watch is replaced by the poll, the budget forgot it
+    std::shared_ptr<InotifyJob> jobEvict(uint64_t job_id) {
+        auto it = jobs_.find(job_id);
+
+        if(it == jobs_.end()) {
+            return nullptr;
+        }
+
+        auto ptr = it->second;
+        auto polled = jobMakePolled(ptr->path().native(), ptr->runtime());
+        spdlog::debug("{}: job id: {:016x}, path: {}, priority: {}", __FUNCTION__, job_id, ptr->path().native(), ptr->desc()->priority);
+
+        // the budget slot is taken over: the release is ignored
+        jobErase(it);
+        jobInsert(polled);
+
+        return polled;
+    }
+
+    /// the lowered budget: the watches over it are polled
+    void jobShrink(void) {
+        std::vector<std::shared_ptr<InotifyJob>> polled;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            for(auto job_id : budget_.shrink()) {
+                if(auto ptr = jobEvict(job_id)) {
+                    polled.emplace_back(std::move(ptr));
+                }
+            }
+        }
+
+        for(auto & ptr : polled) {
+            // the initial snapshot
+            rescan_.schedule(ptr->job_id(), false);
+        }
+
+        if(polled.size()) {
+            spdlog::info("{}: evicted: {}", __FUNCTION__, polled.size());
+        }
+    }
+
+    /// the renamed dir: the watches of the subtree get the new paths, the kernel watches are kept
+    void jobRetarget(std::string_view from, std::string_view to) {
+        const std::string dir{from};
+        const std::string prefix = dir + '/';
+        std::vector<JobIndex::node_type> nodes;
+
+        std::scoped_lock guard{ lock_ };
+
+        for(auto [it, end] = index_.equal_range(dir); it != end;) {
+            nodes.emplace_back(index_.extract(it++));
+        }
+
+        for(auto it = index_.lower_bound(prefix); it != index_.end() && 0 == it->first.compare(0, prefix.size(), prefix);) {
+            nodes.emplace_back(index_.extract(it++));
+        }
+
+        for(auto & node : nodes) {
+            node.key() = std::string{to}.append(node.key(), dir.size());
+            node.mapped()->retarget(node.key());
+            auto ptr = node.mapped();
+            ptr->indexed = index_.insert(std::move(node));
+        }
+
+        if(nodes.size()) {
+            spdlog::info("{}: from: {}, to: {}, watches: {}", __FUNCTION__, from, to, nodes.size());
+        }
+    }
+
+    /// the watch of the job dir, once per runtime: the tree walk and the new dir events race
+    /// over the watch budget or on the kernel limit (ENOSPC) the dir is polled, throw: the dir is not found or not readable
+    /// nullptr: watched already or the job removed, the modified job gets the watch
+    std::shared_ptr<InotifyJob> jobAddDir(const std::string & dir, JobRuntimePtr runtime) {
+        std::shared_ptr<InotifyJob> ptr;
+        std::shared_ptr<InotifyJob> evicted;
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            // the late walk and the new dir events race the reload
+            while(runtime->modified) {
+                runtime = runtime->modified;
+            }
+
+            if(runtime->removed) {
+                return nullptr;
+            }
+
+            for(auto [it, end] = index_.equal_range(dir); it != end; ++it) {
+                if(it->second->runtime() == runtime) {
+                    return nullptr;
+                }
+            }
+
+            auto & desc = *runtime->desc;
+            const size_t depth = jobDepth(dir, desc);
+            uint64_t victim = 0;
+
+            if(budget_.reserve(desc.priority, depth, victim)) {
+                auto jobContinueEventCb = std::bind(&ServiceWatcher::jobContinueEvent, this,
+                        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5);
+
+                if(victim) {
+                    evicted = jobEvict(victim);
+                }
+
+                try {
+                    ptr = std::make_shared<InotifyJob>(instance(dir), dir, runtime, jobContinueEventCb);
+                    budget_.track(ptr->job_id(), desc.priority, depth);
+                } catch(const std::system_error & err) {
+                    budget_.cancel();
+
+                    // ENOSPC: the watches of the other processes, the dir is polled
+                    if(err.code().value() != ENOSPC) {
+                        if(err.code().value() != ENOENT) {
+                            spdlog::warn("{}: dir skipped, path: {}, error: {}", __FUNCTION__, dir, err.code().message());
+                        }
+
+                        throw;
+                    }
+                }
+            }
+
+            if(! ptr) {
+                ptr = jobMakePolled(dir, runtime);
+            }
+
+            jobInsert(ptr);
+        }
+
+        for(auto & job : { ptr, evicted }) {
+            if(job && job->snapshot()) {
+                // the initial snapshot
+                rescan_.schedule(job->job_id(), false);
+            }
+        }
+
+        return ptr;
+    }
+
+    /// the new subdir: the watch first, then the scan for the entries created before it,
+    /// the nested dirs are followed by the synthesized IN_CREATE on the new watch
+    void jobNewDir(std::string_view path, const JobRuntimePtr & runtime) {
+        std::string dir{path};
+
+        // the deeper dirs are not watched, the events of the last level only
+        if(auto max_depth = runtime->desc->maxDepth; max_depth && jobDepth(dir, *runtime->desc) > max_depth) {
+            return;
+        }
+
+        // before the watch: the kernel events of the dir entries are tracked
+        runtime->newDirs->add(dir);
+        std::shared_ptr<InotifyJob> ptr;
+
+        try {
+            ptr = jobAddDir(dir, runtime);
+        } catch(const std::exception &) {
+            // removed already
+        }
+
+        if(! ptr) {
+            runtime->newDirs->done(dir);
+            return;
+        }
+
+        auto found = System::listDir(dir, [&ptr](const char* name, bool is_dir) {
+            ptr->synthesizeCreate(name, is_dir);
+        });
+
+        // the kernel events of the entries created while scanning are queued already: the dir is tracked until they are handled
+        ptr->afterQueued([weak = std::weak_ptr<JobRuntime>(runtime), dir]() {
+            if(auto runtime = weak.lock()) {
+                runtime->newDirs->done(dir);
+            }
+        });
+
+        spdlog::debug("{}: add job, id: {:016x}, path: {}, entries: {}", __FUNCTION__, ptr->job_id(), dir, found);
+    }
+
+    void jobContinueEvent(std::string_view path, uint32_t event, const JobRuntimePtr & runtime, uint64_t job_id, std::string_view from) {
+        if(IN_Q_OVERFLOW == event) {
+            rescan_.schedule(job_id, true);
+            return;
+        }
+
+        // the new dir of the recursive job, the symlinks are not followed
+        const bool isdir = event & IN_ISDIR;
+        event &= ~IN_ISDIR;
+
+        auto & desc = *runtime->desc;
+
+        // the renamed subdir of the tree
+        if(from.size() && desc.recursive && ! desc.fanotify) {
+            jobRetarget(from, path);
+        }
+
+        if(runtime->newDirs) {
+            // the dir moved in from outside the tree: unpaired, followed like the created one
+            if(IN_CREATE == event || (IN_MOVED_TO == event && from.empty())) {
+                // the scanned and the kernel event of the new dir entry: once
+                if(! runtime->newDirs->first(path)) {
+                    return;
+                }
+
+                if(isdir) {
+                    jobNewDir(path, runtime);
+                }
+            } else if(IN_DELETE == event || IN_MOVED_FROM == event) {
+                // the next create of the name is the new entry
+                runtime->newDirs->forget(path);
+            }
+        }
+
+        if(desc.command.empty() && desc.actionType.empty()) {
+            return;
+        }
+
+        spdlog::debug("{}: event: {}", __FUNCTION__, Inotify::maskToName(event));
+
+        if(desc.events & event) {
+            if(runtime->paused) {
+                // the tree is followed, the commands are not run
+                runtime->pausedDropped.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                Inotify::JobMetrics::count(runtime->metrics->dispatched, event);
+
+                if(from.size()) {
+                    // the rename is not merged
+                    jobDispatch(path, event, runtime.get(), from);
+                } else if(runtime->debouncer) {
+                    runtime->debouncer->push(std::filesystem::path{path}, event);
+                } else {
+                    jobDispatch(path, event, runtime.get());
+                }
+            }
+        }
+
+        if(IN_DELETE_SELF == event) {
+            std::scoped_lock guard{ lock_ };
+            // job self delete
+            if(auto it = jobs_.find(job_id); it != jobs_.end()) {
+                spdlog::info("{}: remove job, id: {:016x}, path: {}", __FUNCTION__, job_id, it->second->path().native());
+                jobErase(it);
+            }
+        }
+    }
+
+    void readConfig(const std::filesystem::path & path) {
+        std::ifstream ifs{path};
+        system::error_code ec;
+        auto json = json::parse(std::string{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()}, ec);
+
+        if(ec) {
+            spdlog::error("{}: {} error, code: {}, message: {}", __FUNCTION__, "json", ec.value(), ec.message());
+            return;
+        }
+
+        if(! json.is_object()) {
+            spdlog::error("{}: {} failed, not object", __FUNCTION__, "json");
+            return;
+        }
+
+        conf_ = json.as_object();
+
+        bool debug = conf_.contains("debug") ? json::value_to<bool>(conf_["debug"]) : false;
+        spdlog::set_level(debug ? spdlog::level::debug : spdlog::level::info);
+
+        // global commands limits, 0: unlimited
+        size_t max_parallel = conf_.contains("max_parallel") ? json::value_to<size_t>(conf_["max_parallel"]) : 64;
+        size_t max_queue = conf_.contains("max_queue") ? json::value_to<size_t>(conf_["max_queue"]) : 4096;
+        executor_.setLimits(max_parallel, max_queue);
+
+        size_t rescan_rate = conf_.contains("rescan_rate") ? json::value_to<size_t>(conf_["rescan_rate"]) : 50;
+        rescan_.setRate(rescan_rate);
+
+        // empty: disabled
+        metrics_file_ = conf_.contains("metrics_file") ? json::value_to<std::string>(conf_["metrics_file"]) : std::string{};
+        metrics_interval_ = std::chrono::seconds(conf_.contains("metrics_interval") ? json::value_to<size_t>(conf_["metrics_interval"]) : 10);
+
+        if(metrics_interval_.count() == 0) {
+            metrics_interval_ = std::chrono::seconds(1);
+        }
+
+        // 0: the kernel max_user_watches less the reserve
+        budget_.setLimit(conf_.contains("watch_budget") ? json::value_to<size_t>(conf_["watch_budget"]) : 0);
+        jobShrink();
+        poll_interval_ = std::chrono::seconds(std::max(conf_.contains("poll_interval") ? json::value_to<size_t>(conf_["poll_interval"]) : 30, size_t(1)));
+
+        if(! conf_.contains("jobs") || ! conf_["jobs"].is_array()) {
+            spdlog::warn("{}: config jobs empty", __FUNCTION__);
+        }
+
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::loadConfigJobs, this, path));
+
+        spdlog::info("{}: success", __FUNCTION__);
+    }
+
+    void loadFileJob(const std::filesystem::path & file) {
+        if(file.extension() != ".job") {
+            spdlog::debug("{}: skipped job: {}", __FUNCTION__, file.native());
+            return;
+        }
+
+        std::ifstream ifs{file};
+        system::error_code ec;
+        auto json = json::parse(std::string{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()}, ec);
+
+        if(ec) {
+            spdlog::warn("{}: {} error, code: {}, message: {}", __FUNCTION__, "json", ec.value(), ec.message());
+            return;
+        }
+
+        if(! json.is_object()) {
+            spdlog::warn("{}: {} failed, not object", __FUNCTION__, "json");
+            return;
+        }
+
+        syncJobs(file.native(), { & json.get_object() });
+    }
+
+    void loadDirJobs(void) {
+        for(const auto & file: System::readDir(jobs_dir_, false, ReadDirFilter::File)) {
+            loadFileJob(file);
+        }
+    }
+
+    void loadConfigJobs(const std::filesystem::path & path) {
+        std::vector<const json::object*> confs;
+
+        if(conf_.contains("jobs") && conf_["jobs"].is_array()) {
+            for(auto & json : conf_["jobs"].get_array()) {
+                if(! json.is_object()) {
+                    spdlog::warn("{}: job skipped, not object", __FUNCTION__);
+                    continue;
+                }
+
+                confs.push_back(& json.get_object());
+            }
+        }
+
+        syncJobs(path.native(), confs);
+    }
+
+    /// metrics: the modified job keeps the counters
+    /// return nullptr: the action failed, the job skipped
+    JobRuntimePtr makeRuntime(const Inotify::JobDescPtr & desc, Inotify::JobMetricsPtr metrics = nullptr) {
+        Inotify::ActionPtr action;
+
+        if(desc->actionType.size()) {
+            try {
+                // after the owner: the created files
+                action = Inotify::makeAction(desc->action, desc->path.native(), desc->owner);
+            } catch(const std::exception & err) {
+                spdlog::warn("{}: job skipped, path: {}, action: {}, error: {}", __FUNCTION__, desc->path.native(), desc->actionType, err.what());
+                return nullptr;
+            }
+        }
+
+        auto runtime = std::make_shared<JobRuntime>();
+        runtime->desc = desc;
+        runtime->metrics = metrics ? std::move(metrics) : Inotify::metrics().addJob(desc->path.native());
+        runtime->group = std::make_shared<System::CommandExecutor::Group>(desc->path.native(), desc->maxParallel, runtime->metrics);
+
+        if(desc->worker && desc->command.size()) {
+            runtime->worker = std::make_shared<System::Worker>(ioc_, reaper_, System::Command{desc->command, {}, desc->owner, {}},
+                                    (desc->workerBinary ? System::WorkerFormat::Binary : System::WorkerFormat::Json), desc->workerQueue, runtime->metrics,
+                                    (journal_ && desc->journal ? System::WorkerAckCb([journal = journal_](uint64_t seq){ journal->ack(seq); }) : nullptr));
+            runtime->worker->run();
+        } else if(1 < desc->batchMax) {
+            runtime->batcher = std::make_unique<Inotify::Batcher>(ioc_, desc->batchMax, desc->batchWindow,
+                    std::bind(&ServiceWatcher::jobRunBatch, this, std::placeholders::_1, runtime.get()));
+        }
+
+        if(desc->recursive && ! desc->fanotify) {
+            runtime->newDirs = std::make_unique<Inotify::NewDirs>();
+        }
+
+        if(action) {
+            // in-process: no fork and exec per event
+            runtime->action = std::make_unique<Inotify::ActionRunner>(*actions_, std::move(action), desc->actionQueue, runtime->metrics,
+                                    (journal_ && desc->journal ? Inotify::ActionAckCb([journal = journal_](uint64_t seq){ journal->ack(seq); }) : nullptr));
+        }
+
+        if(desc->skipUnchanged && (desc->command.size() || runtime->action)) {
+            // ~JobRuntime resets the filter first, its destructor waits the running callback
+            runtime->unchanged = std::make_unique<Inotify::UnchangedFilter>(*hasher_, desc->unchangedCache, runtime->metrics,
+                    [this, ptr = runtime.get()](const std::string & path, uint32_t mask, const std::string & from) {
+                        this->jobAdmit(path, mask, ptr, from);
+                    });
+        }
+
+        if(0 < desc->rateLimit) {
+            // the coalesced events are flushed as the tokens refill
+            runtime->limiter = std::make_unique<Inotify::RateLimiter>(ioc_, desc->rateLimit, desc->rateBurst, desc->ratePolicy, runtime->metrics,
+                    [this, ptr = runtime.get()](const std::string & path, uint32_t mask, const std::string & from) {
+                        this->jobDeliver(path, mask, ptr, 0, false, from);
+                    });
+        }
+
+        if(0 < desc->debounce.count()) {
+            // runtime owns the debouncer, raw pointer without cycle, ~JobRuntime stops it first
+            runtime->debouncer = std::make_unique<Inotify::Debouncer>(ioc_, desc->debounce,
+                    [this, ptr = runtime.get()](const std::filesystem::path & path, uint32_t mask) {
+                        this->jobDispatch(path.native(), mask, ptr);
+                    });
+        }
+
+        return runtime;
+    }
+
+    /// remove all watches of the job, the recursive subdirs also
+    void jobRemove(const JobRuntimePtr & runtime) {
+        std::scoped_lock guard{ lock_ };
+        // jobAddDir checks it under the lock
+        runtime->removed = true;
+
+        // the job watches only, jobErase updates the set
+        auto watches = std::move(runtime->watches);
+        runtime->watches.clear();
+
+        for(auto job_id : watches) {
+            if(auto it = jobs_.find(job_id); it != jobs_.end()) {
+                spdlog::debug("{}: remove job, id: {:016x}, path: {}", __FUNCTION__, job_id, it->second->path().native());
+                jobErase(it);
+            }
+        }
+
+        spdlog::info("{}: path: {}, watches: {}", __FUNCTION__, runtime->desc->path.native(), watches.size());
+    }
+
+    /// the kernel watches are kept, only the runtime settings changed
+    void jobModify(const JobRuntimePtr & runtime, const JobRuntimePtr & modified) {
+        std::scoped_lock guard{ lock_ };
+        // jobAddDir follows it under the lock
+        runtime->modified = modified;
+
+        for(auto job_id : runtime->watches) {
+            if(auto it = jobs_.find(job_id); it != jobs_.end()) {
+                spdlog::debug("{}: modify job, id: {:016x}, path: {}", __FUNCTION__, job_id, it->second->path().native());
+                it->second->setRuntime(modified);
+            }
+        }
+
+        spdlog::info("{}: path: {}, watches: {}", __FUNCTION__, runtime->desc->path.native(), runtime->watches.size());
+
+        // the control state
+        modified->watches = std::move(runtime->watches);
+        modified->id = runtime->id;
+        modified->source = runtime->source;
+        modified->key = runtime->key;
+        modified->paused = runtime->paused.load();
+    }
+
+    /// the control id of the loaded job
+    void jobAttach(const JobRuntimePtr & runtime, const std::string & source, const std::string & key) {
+        runtime->id = ++runtimeSeq_;
+        runtime->source = source;
+        runtime->key = key;
+        runtimes_.emplace(runtime->id, runtime);
+    }
+
+    /// diff the loaded jobs of the source with the new configs, unchanged jobs are untouched
+    void syncJobs(const std::string & source, const std::vector<const json::object*> & confs) {
+        JobsSource prev;
+
+        if(auto it = sources_.find(source); it != sources_.end()) {
+            prev = std::move(it->second);
+            sources_.erase(it);
+        }
+
+        JobsSource cur;
+        std::list<std::pair<std::string, Inotify::JobDescPtr>> added;
+        size_t unchanged = 0;
+
+        for(auto jo : confs) {
+            auto key = json::serialize(*jo);
+
+            if(cur.count(key) || std::any_of(added.begin(), added.end(), [&](auto & pair){ return pair.first == key; })) {
+                spdlog::warn("{}: job skipped, duplicate, source: {}", __FUNCTION__, source);
+                continue;
+            }
+
+            if(auto it = prev.find(key); it != prev.end()) {
+                cur.emplace(std::move(key), std::move(it->second));
+                prev.erase(it);
+                unchanged++;
+            } else if(auto desc = Inotify::compileJob(*jo)) {
+                added.emplace_back(std::move(key), std::move(desc));
+            }
+        }
+
+        size_t modified = 0;
+
+        // the same watches with the new settings
+        for(auto it = added.begin(); it != added.end(); ) {
+            auto & [key, desc] = *it;
+            auto old = std::find_if(prev.begin(), prev.end(), [&](auto & pair){ return Inotify::sameWatches(*pair.second->desc, *desc); });
+
+            if(old != prev.end()) {
+                auto runtime = makeRuntime(desc, old->second->metrics);
+
+                if(! runtime) {
+                    // as the invalid config: the old job removed
+                    it = added.erase(it);
+                    continue;
+                }
+
+                jobModify(old->second, runtime);
+                runtime->key = key;
+                runtimes_[runtime->id] = runtime;
+                cur.emplace(std::move(key), std::move(runtime));
+                prev.erase(old);
+                it = added.erase(it);
+                modified++;
+            } else {
+                ++it;
+            }
+        }
+
+        const size_t removed = prev.size();
+
+        for(auto & [key, runtime] : prev) {
+            jobRemove(runtime);
+            runtimes_.erase(runtime->id);
+        }
+
+        for(auto & [key, desc] : added) {
+            if(auto runtime = loadJob(desc)) {
+                jobAttach(runtime, source, key);
+                cur.emplace(std::move(key), std::move(runtime));
+            }
+        }
+
+        spdlog::info("{}: source: {}, unchanged: {}, modified: {}, removed: {}, added: {}", __FUNCTION__,
+                        source, unchanged, modified, removed, added.size());
+
+        if(cur.size()) {
+            sources_.emplace(source, std::move(cur));
+        }
+    }
+
+    void jobWalk(const JobRuntimePtr & runtime) {
+        auto & path = runtime->desc->path;
+
+        // walker threads
+        auto stats = System::walkDirs(path, walk_threads_, 256,
+            [this, runtime](std::vector<std::string> && dirs) {
+                asio::post(conf_strand_, [this, runtime, dirs = std::move(dirs)]() {
+                    this->jobRegisterDirs(dirs, runtime);
+                });
+            },
+            [this, runtime]() {
+                return this->shutdown_ || runtime->removed;
+            },
+            [filter = runtime->desc->filter](std::string_view name) {
+                return filter && filter->pruneDir(name);
+            }, runtime->desc->maxDepth);
+
+        spdlog::info("{}: path: {}, dirs: {}, entries: {}, errors: {}, elapsed: {}ms, entries/sec: {}", __FUNCTION__,
+                        path.native(), stats.dirs, stats.entries, stats.errors, stats.elapsed.count(), stats.entriesPerSec());
+    }
+
+    void jobRegisterDirs(const std::vector<std::string> & dirs, const JobRuntimePtr & runtime) {
+        // jobAddDir follows the modified job
+        if(shutdown_) {
+            return;
+        }
+
+        for(const auto & dir : dirs) {
+            try {
+                // the dirs created while walking may be added by the events
+                if(auto ptr = jobAddDir(dir, runtime)) {
+                    spdlog::debug("{}: add job, id: {:016x}, path: {}", __FUNCTION__, ptr->job_id(), dir);
+                }
+            } catch(const std::exception &) {
+                // removed while walking
+            }
+        }
+    }
+
+    JobRuntimePtr loadJob(const Inotify::JobDescPtr & desc) {
+        auto & path = desc->path;
+
+        if(! std::filesystem::is_regular_file(path) && ! std::filesystem::is_directory(path)) {
+            spdlog::warn("{}: job skipped, path not found: {}", __FUNCTION__, path.native());
+            return nullptr;
+        }
+
+        auto runtime = makeRuntime(desc);
+
+        if(! runtime) {
+            return nullptr;
+        }
+
+        auto jobContinueEventCb = std::bind(&ServiceWatcher::jobContinueEvent, this,
+                    std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4, std::placeholders::_5);
+
+        if(desc->fanotify) {
+            try {
+                auto ptr = std::make_shared<InotifyJob>(ioc_, desc->watch, runtime, std::move(jobContinueEventCb));
+                ptr->startFanotify();
+                spdlog::info("{}: add job, id: {:016x}, path: {}, backend: {}", __FUNCTION__, ptr->job_id(), desc->watch.native(), "fanotify");
+                jobRegister(std::move(ptr));
+            } catch(const std::exception &) {
+                spdlog::warn("{}: job skipped, fanotify failed, path: {}", __FUNCTION__, path.native());
+                return nullptr;
+            }
+        } else if(desc->recursive && std::filesystem::is_directory(path)) {
+            // the watches are added while walking
+            asio::post(walker_, std::bind(&ServiceWatcher::jobWalk, this, runtime));
+        } else {
+            std::shared_ptr<InotifyJob> ptr;
+
+            try {
+                // the watch budget: may be polled
+                ptr = jobAddDir(desc->watch.native(), runtime);
+            } catch(const std::exception &) {
+                // the other jobs are loaded
+                spdlog::warn("{}: job skipped, watch failed, path: {}", __FUNCTION__, desc->watch.native());
+                return nullptr;
+            }
+
+            if(ptr && desc->name.size()) {
+                spdlog::info("{}: add job, id: {:016x}, path: {}, name: {}, polled: {}", __FUNCTION__, ptr->job_id(), desc->watch.native(), desc->name, ptr->polled());
+            } else if(ptr) {
+                spdlog::info("{}: add job, id: {:016x}, path: {}, polled: {}", __FUNCTION__, ptr->job_id(), desc->watch.native(), ptr->polled());
+            }
+        }
+
+        return runtime;
+    }
+
+  public:
+    ServiceWatcher(boost::asio::io_context & ioc, const std::filesystem::path & conf_path, const std::filesystem::path & jobs_dir)
+        : ioc_(ioc), signals_(ioc), jobs_dir_(jobs_dir), reaper_(ioc), executor_(reaper_, 0, 0), conf_strand_(asio::make_strand(ioc)), metrics_timer_(conf_strand_), poll_timer_(conf_strand_),
+            rescan_(std::bind(&ServiceWatcher::jobRescan, this, std::placeholders::_1, std::placeholders::_2)) {
+        spdlog::info("found config: {}", conf_path.native());
+        readConfig(conf_path);
+
+        // the journal is not reopened on the config reload
+        if(auto file = conf_.contains("journal_file") ? json::value_to<std::string>(conf_["journal_file"]) : std::string{}; file.size()) {
+            size_t size_mb = conf_.contains("journal_size_mb") ? json::value_to<size_t>(conf_["journal_size_mb"]) : 64;
+            size_t sync_ms = conf_.contains("journal_sync_ms") ? json::value_to<size_t>(conf_["journal_sync_ms"]) : 100;
+
+            try {
+                journal_ = std::make_shared<Inotify::Journal>(file, size_mb * 1024 * 1024, std::chrono::milliseconds(sync_ms));
+            } catch(const std::exception &) {
+                spdlog::error("{}: journal disabled, path: {}", __FUNCTION__, file);
+            }
+        }
+
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::loadDirJobs, this));
+
+        if(journal_) {
+            asio::post(conf_strand_, std::bind(& ServiceWatcher::journalReplay, this));
+        }
+
+        // the io_context threads
+        threads_ = conf_.contains("threads") ? json::value_to<size_t>(conf_["threads"]) : 4;
+
+        // the recursive jobs tree walk
+        walk_threads_ = conf_.contains("walk_threads") ? json::value_to<size_t>(conf_["walk_threads"]) : 4;
+
+        // before the jobs load
+        size_t hash_threads = conf_.contains("hash_threads") ? json::value_to<size_t>(conf_["hash_threads"]) : 2;
+        hasher_ = std::make_unique<asio::thread_pool>(std::max(hash_threads, size_t(1)));
+
+        size_t action_threads = conf_.contains("action_threads") ? json::value_to<size_t>(conf_["action_threads"]) : 4;
+        actions_ = std::make_unique<asio::thread_pool>(std::max(action_threads, size_t(1)));
+
+        // shared inotify descriptors, watches are distributed by path hash
+        size_t count = conf_.contains("inotify_instances") ? json::value_to<size_t>(conf_["inotify_instances"]) : 1;
+
+        if(auto kernel = budget_.kernel(); kernel.maxUserInstances && count >= kernel.maxUserInstances) {
+            spdlog::warn("{}: inotify instances over the kernel limit, count: {}, max_user_instances: {}", __FUNCTION__, count, kernel.maxUserInstances);
+            count = kernel.maxUserInstances / 2;
+        }
+
+        // the IN_MOVED_FROM wait for the IN_MOVED_TO pair
+        size_t rename_ms = conf_.contains("rename_timeout_ms") ? json::value_to<size_t>(conf_["rename_timeout_ms"]) : 20;
+
+        // epoll: the asio reactor, io_uring: one ring for the reads of all instances
+        if(auto engine = conf_.contains("io_engine") ? json::value_to<std::string>(conf_["io_engine"]) : std::string{"epoll"}; engine == "io_uring") {
+            try {
+                uring_ = std::make_unique<Inotify::Uring>(ioc_);
+                // the command exits: the pidfd polls on the same ring
+                reaper_.setUring(uring_.get());
+
+                // the statx of the hot dentries is punted to the io-wq: slower than the syscalls on the most filesystems
+                if(conf_.contains("io_uring_scans") && json::value_to<bool>(conf_["io_uring_scans"])) {
+                    scanRing_ = std::make_unique<Inotify::UringScan>();
+                }
+            } catch(const std::exception &) {
+                reaper_.setUring(nullptr);
+                uring_.reset();
+                spdlog::warn("{}: io_uring failed, the engine: {}", __FUNCTION__, "epoll");
+            }
+        } else if(engine != "epoll") {
+            spdlog::warn("{}: unknown io_engine: {}, the engine: {}", __FUNCTION__, engine, "epoll");
+        }
+
+        for(size_t it = 0; it < std::max(count, size_t(1)); ++it) {
+            instances_.emplace_back(std::make_unique<Inotify::Instance>(ioc_, std::chrono::milliseconds(rename_ms), uring_.get()));
+        }
+
+        conf_job_ = std::make_shared<InotifyConfFile>(instance(conf_path.parent_path()), conf_path, std::bind(&ServiceWatcher::confFileModifyEvent, this, std::placeholders::_1));
+
+        if(std::filesystem::is_directory(jobs_dir)) {
+            dir_jobs_ = std::make_shared<InotifyConfDir>(instance(jobs_dir), jobs_dir, std::bind(&ServiceWatcher::confDirModifyEvent, this,
+                                                            std::placeholders::_1, std::placeholders::_2));
+        }
+
+        signals_.add(SIGINT);
+        signals_.add(SIGTERM);
+        signals_.add(SIGUSR1);
+
+        waitSignals();
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::writeMetrics, this));
+        asio::post(conf_strand_, std::bind(& ServiceWatcher::pollJobs, this));
+
+        // empty: disabled
+        if(auto file = conf_.contains("control_socket") ? json::value_to<std::string>(conf_["control_socket"]) : std::string{}; file.size()) {
+            auto mode = conf_.contains("control_mode") ? json::value_to<std::string>(conf_["control_mode"]) : std::string{"0600"};
+
+            try {
+                control_ = std::make_unique<Inotify::ControlServer>(ioc_, file, std::stoul(mode, nullptr, 8),
+                            std::bind(& ServiceWatcher::controlRequest, this, std::placeholders::_1, std::placeholders::_2));
+            } catch(const std::exception &) {
+                spdlog::error("{}: control disabled, path: {}", __FUNCTION__, file);
+            }
+        }
+    }
+
+    size_t threads(void) const {
+        return std::max(threads_, size_t(1));
+    }
+
+    ~ServiceWatcher() {
+        // abort the tree walks
+        shutdown_ = true;
+        walker_.join();
+
+        // the pending hashes are dropped
+        hasher_->stop();
+        hasher_->join();
+
+        // the queued actions are finished
+        actions_->join();
+    }
+
+    void status(void) const {
+        std::scoped_lock guard{ lock_ };
+        spdlog::info("{}: jobs count: {}, sources: {}, running commands: {}", __FUNCTION__, jobs_.size(), sources_.size(), reaper_.countRunning());
+
+        for(const auto & inst: instances_) {
+            spdlog::info("{}: inotify instance: {:016x}, watches: {}, overflows: {}, renames: {}", __FUNCTION__,
+                            reinterpret_cast<uint64_t>(inst.get()), inst->countWatches(), inst->countOverflows(), inst->countRenames());
+        }
+
+        executor_.status();
+        rescan_.status();
+        budget_.status();
+
+        if(journal_) {
+            journal_->status();
+        }
+
+        // conf strand: the sources are stable
+        for(const auto & [source, jobs] : sources_) {
+            for(const auto & [key, runtime] : jobs) {
+                if(runtime->worker) {
+                    runtime->worker->status();
+                }
+
+                if(runtime->limiter) {
+                    runtime->limiter->status(runtime->desc->path.native());
+                }
+
+                if(runtime->newDirs) {
+                    runtime->newDirs->status(runtime->desc->path.native());
+                }
+
+                if(runtime->unchanged) {
+                    runtime->unchanged->status(runtime->desc->path.native());
+                }
+
+                auto [watches, polled] = jobUsage(*runtime);
+                spdlog::info("{}: job: {}, priority: {}, watches: {}, polled: {}", __FUNCTION__,
+                                runtime->desc->path.native(), runtime->desc->priority, watches, polled);
+            }
+        }
+
+        for(const auto & [job_id, ptr] : jobs_) {
+            auto desc = ptr->desc();
+            spdlog::info("{}: job id: {:016x}, path: {}, cmd: {}", __FUNCTION__, job_id, ptr->path().native(), desc->command);
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+
+    const char* conf_path = "/etc/inotify_watcher/config.json";
+    const char* jobs_dir = "/etc/inotify_watcher/jobs.d";
+
+    if(auto env = getenv("INOTIFY_SERVICE_CONF")) {
+        conf_path = env;
+    }
+
+    if(auto env = getenv("INOTIFY_JOBS_DIR")) {
+        jobs_dir = env;
+    }
+
+    if(1 < argc) {
+        if(0 == strcmp(argv[1], "--help")) {
+            std::cout << "usage: " << argv[0] << " --config <json config>" << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        if(0 == strcmp(argv[1], "--config")) {
+            conf_path = argv[2];
+        }
+    }
+
+    if(! std::filesystem::is_regular_file(conf_path)) {
+        std::cerr << "config not found: " << conf_path << std::endl;
+        std::cout << "usage: " << argv[0] << " --config <json config>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto sink = std::make_shared<spdlog::sinks::systemd_sink_mt>();
+    auto logger = std::make_shared<spdlog::logger>("inotify_watcher", sink);
+
+    spdlog::register_logger(logger);
+    spdlog::set_default_logger(logger);
+
+    spdlog::set_pattern("%v");
+    spdlog::set_level(spdlog::level::info);
+
+    // the commands stdin pipes may be closed by the child
+    signal(SIGPIPE, SIG_IGN);
+
+    asio::io_context ctx{4};
+
+    auto runContext = [&ctx]() {
+        try {
+            ctx.run();
+        } catch(const std::exception & err) {
+            spdlog::error("{}: exception: {}", "runContext", err.what());
+            ctx.stop();
+        }
+    };
+
+    try {
+        auto app = std::make_unique<ServiceWatcher>(ctx, conf_path, jobs_dir);
         sd_notify(0, "READY=1");
-        ctx.run();
+
+        // the handlers of the different watches run in parallel
+        std::vector<std::thread> threads;
+
+        for(size_t it = 1; it < app->threads(); ++it) {
+            threads.emplace_back(runContext);
+        }
+
+        runContext();
+
+        for(auto & thread : threads) {
+            thread.join();
+        }
+
         spdlog::info("service stopped");
     } catch(const std::exception & err) {
         std::cerr << "exception: " << err.what() << std::endl;
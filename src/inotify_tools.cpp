@@ -8,8 +8,6 @@
  *                                                                         *
  ***************************************************************************/
 
-#include <pwd.h>
-#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -17,7 +15,6 @@
 
 #include <spdlog/spdlog.h>
 
-#include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/inotify.h>
 
@@ -91,6 +88,27 @@ namespace Inotify {
 
         return 0;
     }
+
+    std::string maskToString(uint32_t mask) {
+        if(auto name = maskToName(mask)) {
+            return name;
+        }
+
+        // merged events: IN_MODIFY|IN_CLOSE_WRITE
+        std::string res;
+
+        for(const auto & val : allMasks) {
+            if(mask & val) {
+                if(res.size()) {
+                    res.append("|");
+                }
+
+                res.append(maskToName(val));
+            }
+        }
+
+        return res;
+    }
 }
 
 namespace System {
@@ -145,68 +163,14 @@ namespace System {
         return res;
     }
 
-    void runCommand(std::string cmd, std::list<std::string> args, std::string owner) {
-        pid_t pid = fork();
-
-        if(0 < pid) {
-            int status;
-
-            if(0 > waitpid(pid, & status, 0)) {
-                spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "waitpid", strerror(errno), errno);
-            }
-
-            return;
-
-        } else if(0 > pid) {
-            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "fork", strerror(errno), errno);
-            return;
-        }
+    const uint64_t LOG_THROTTLE = 1000;
 
-        // child mode: pid == 0
-        for(int fd = 0; fd < 256; ++fd) {
-            close(fd);
-        }
-
-        // stdin
-        open("/dev/null", O_RDONLY);
-        // stdout
-        open("/dev/null", O_WRONLY | O_APPEND);
-        // stderr
-        open("/dev/null", O_WRONLY | O_APPEND);
-
-        // goto tmp
-        chdir("/tmp");
-
-        if(0 == getuid() && ! owner.empty() && owner != "root") {
-            struct passwd* pwd = getpwnam(owner.c_str());
-
-            if(pwd && pwd->pw_uid) {
-                setgid(pwd->pw_gid);
-
-                if(0 > setuid(pwd->pw_uid)) {
-                    spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "setuid", strerror(errno), errno);
-                    std::exit(-1);
-                }
-
-                setenv("USER", pwd->pw_name, 1);
-                setenv("LOGNAME", pwd->pw_name, 1);
-                setenv("HOME", pwd->pw_dir, 1);
-            }
-        }
-
-        std::vector<const char*> argv;
-        argv.reserve(args.size() + 2);
-
-        argv.push_back(cmd.c_str());
-
-        for(auto & val : args) {
-            argv.push_back(val.c_str());
-        }
-
-        argv.push_back(nullptr);
+    bool logThrottled(uint64_t & counter) {
+        return 0 == (counter++ % LOG_THROTTLE);
+    }
 
-        execv(cmd.c_str(), (char* const*) argv.data());
-        std::exit(-1);
+    bool logThrottled(std::atomic<uint64_t> & counter) {
+        return 0 == (counter.fetch_add(1, std::memory_order_relaxed) % LOG_THROTTLE);
     }
 }
 
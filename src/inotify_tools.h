@@ -12,6 +12,7 @@
 #define _INOTIFY_TOOLS_
 
 #include <list>
+#include <atomic>
 #include <string>
 #include <filesystem>
 #include <forward_list>
@@ -21,11 +22,15 @@ enum class ReadDirFilter { All, Dir, File };
 namespace Inotify {
     const char* maskToName(uint32_t mask);
     uint32_t nameToMask(std::string_view name);
+    std::string maskToString(uint32_t mask);
 }
 
 namespace System {
     std::forward_list<std::string> readDir(const std::filesystem::path & path, bool recursive, const ReadDirFilter & filter = ReadDirFilter::All);
-    void runCommand(std::string cmd, std::list<std::string> args, std::string owner);
+
+    /// the repeated warning: counted, true for the first and every 1000th, do not flood the journal
+    bool logThrottled(uint64_t & counter);
+    bool logThrottled(std::atomic<uint64_t> & counter);
 }
 
 namespace String {
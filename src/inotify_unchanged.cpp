@@ -0,0 +1,368 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "inotify_unchanged.h"
+
+using namespace boost;
+
+namespace Inotify {
+    const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+    const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+    // the read buffer of the hashed file
+    const size_t HASH_CHUNK = 256 * 1024;
+
+    static inline uint64_t rotl64(uint64_t val, int bits) {
+        return (val << bits) | (val >> (64 - bits));
+    }
+
+    static inline uint64_t read64(const uint8_t* ptr) {
+        uint64_t val;
+        memcpy(& val, ptr, sizeof(val));
+        return val;
+    }
+
+    static inline uint32_t read32(const uint8_t* ptr) {
+        uint32_t val;
+        memcpy(& val, ptr, sizeof(val));
+        return val;
+    }
+
+    static inline uint64_t round64(uint64_t acc, uint64_t input) {
+        acc += input * PRIME64_2;
+        return rotl64(acc, 31) * PRIME64_1;
+    }
+
+    static inline uint64_t merge64(uint64_t acc, uint64_t val) {
+        acc ^= round64(0, val);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    Xxh64::Xxh64(uint64_t seed) : seed_(seed) {
+        acc_[0] = seed + PRIME64_1 + PRIME64_2;
+        acc_[1] = seed + PRIME64_2;
+        acc_[2] = seed;
+        acc_[3] = seed - PRIME64_1;
+    }
+
+    void Xxh64::update(const void* data, size_t len) {
+        auto ptr = static_cast<const uint8_t*>(data);
+        auto end = ptr + len;
+        total_ += len;
+
+        // the tail of the previous update
+        if(memSize_) {
+            size_t fill = std::min(len, sizeof(mem_) - memSize_);
+            memcpy(mem_ + memSize_, ptr, fill);
+            memSize_ += fill;
+            ptr += fill;
+
+            if(memSize_ < sizeof(mem_)) {
+                return;
+            }
+
+            for(int it = 0; it < 4; ++it) {
+                acc_[it] = round64(acc_[it], read64(mem_ + it * 8));
+            }
+
+            memSize_ = 0;
+        }
+
+        // the stripes of 32 bytes
+        while(ptr + 32 <= end) {
+            acc_[0] = round64(acc_[0], read64(ptr));
+            acc_[1] = round64(acc_[1], read64(ptr + 8));
+            acc_[2] = round64(acc_[2], read64(ptr + 16));
+            acc_[3] = round64(acc_[3], read64(ptr + 24));
+            ptr += 32;
+        }
+
+        if(ptr < end) {
+            memcpy(mem_, ptr, end - ptr);
+            memSize_ = end - ptr;
+        }
+    }
+
+    uint64_t Xxh64::digest(void) const {
+        uint64_t hash;
+
+        if(total_ >= 32) {
+            hash = rotl64(acc_[0], 1) + rotl64(acc_[1], 7) + rotl64(acc_[2], 12) + rotl64(acc_[3], 18);
+
+            for(int it = 0; it < 4; ++it) {
+                hash = merge64(hash, acc_[it]);
+            }
+        } else {
+            hash = seed_ + PRIME64_5;
+        }
+
+        hash += total_;
+
+        auto ptr = mem_;
+        auto end = mem_ + memSize_;
+
+        while(ptr + 8 <= end) {
+            hash ^= round64(0, read64(ptr));
+            hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+            ptr += 8;
+        }
+
+        if(ptr + 4 <= end) {
+            hash ^= static_cast<uint64_t>(read32(ptr)) * PRIME64_1;
+            hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+            ptr += 4;
+        }
+
+        while(ptr < end) {
+            hash ^= (*ptr) * PRIME64_5;
+            hash = rotl64(hash, 11) * PRIME64_1;
+            ptr++;
+        }
+
+        // avalanche
+        hash ^= hash >> 33;
+        hash *= PRIME64_2;
+        hash ^= hash >> 29;
+        hash *= PRIME64_3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+    uint64_t xxh64(const void* data, size_t len, uint64_t seed) {
+        Xxh64 state{seed};
+        state.update(data, len);
+        return state.digest();
+    }
+
+    Content* ContentCache::find(std::string_view path) {
+        auto it = index_.find(path);
+
+        if(it == index_.end()) {
+            return nullptr;
+        }
+
+        // the most recent at the front
+        order_.splice(order_.begin(), order_, it->second);
+        return & it->second->second;
+    }
+
+    bool ContentCache::store(std::string_view path, const Content & content) {
+        if(auto ptr = find(path)) {
+            *ptr = content;
+            return false;
+        }
+
+        bool evicted = false;
+
+        if(capacity_ && index_.size() >= capacity_) {
+            index_.erase(order_.back().first);
+            order_.pop_back();
+            evicted = true;
+        }
+
+        order_.emplace_front(std::string(path), content);
+        index_.emplace(order_.front().first, order_.begin());
+
+        return evicted;
+    }
+
+    void ContentCache::forget(std::string_view path) {
+        if(auto it = index_.find(path); it != index_.end()) {
+            auto node = it->second;
+            index_.erase(it);
+            order_.erase(node);
+        }
+    }
+
+    bool readContent(const std::string & path, const Content* cached, Content & res, uint64_t & hashed) {
+        hashed = 0;
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if(0 > fd) {
+            spdlog::debug("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, path);
+            return false;
+        }
+
+        // the timestamps clock: the writes after it get the ctime not older
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, & now);
+
+        struct stat st;
+
+        if(0 > fstat(fd, & st) || ! S_ISREG(st.st_mode)) {
+            close(fd);
+            return false;
+        }
+
+        res.inode = st.st_ino;
+        res.size = st.st_size;
+        res.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        res.ctime = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+
+        // not written: closed after the open for write
+        // racy: the same size rewrite in the timestamp tick of the last hash keeps the stat, the stat is trusted when the change is older
+        if(cached && cached->inode == res.inode && cached->size == res.size && cached->mtime == res.mtime &&
+                cached->ctime == res.ctime && cached->ctime < cached->checked) {
+            res.hash = cached->hash;
+            res.checked = cached->checked;
+            close(fd);
+            return true;
+        }
+
+        res.checked = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+
+        // the streaming read: the mmap is SIGBUS on the truncate by the writer
+        std::vector<uint8_t> buf(HASH_CHUNK);
+        Xxh64 state;
+
+        while(true) {
+            auto len = read(fd, buf.data(), buf.size());
+
+            if(0 > len) {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "read", strerror(errno), errno, path);
+                close(fd);
+                return false;
+            }
+
+            if(0 == len) {
+                break;
+            }
+
+            state.update(buf.data(), len);
+            hashed += len;
+        }
+
+        close(fd);
+        res.hash = state.digest();
+
+        return true;
+    }
+
+    struct UnchangedFilter::State {
+        asio::strand<asio::thread_pool::executor_type> strand;
+        // the strand only
+        ContentCache cache;
+        JobMetricsPtr metrics;
+        UnchangedPassCb passCb;
+
+        // the callback and the owner destructor
+        std::mutex lock;
+        std::atomic<bool> stopped{false};
+
+        std::atomic<size_t> entries{0};
+        Counter hashed{0};
+        Counter hashedBytes{0};
+        Counter unchanged{0};
+        Counter evicted{0};
+
+        State(asio::thread_pool & pool, size_t capacity, JobMetricsPtr ptr, UnchangedPassCb && func)
+            : strand(asio::make_strand(pool.get_executor())), cache(capacity), metrics(std::move(ptr)), passCb(std::move(func)) {}
+
+        /// true: the same content as the last time
+        bool same(const std::string & path, uint32_t mask, const std::string & from) {
+            // the rename and the delete: the content goes with the new name
+            if(mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+                cache.forget(path);
+
+                if(from.size()) {
+                    cache.forget(from);
+                }
+            }
+
+            if(0 == (mask & IN_CLOSE_WRITE)) {
+                return false;
+            }
+
+            auto cached = cache.find(path);
+            Content content;
+            uint64_t bytes = 0;
+
+            if(! readContent(path, cached, content, bytes)) {
+                cache.forget(path);
+                return false;
+            }
+
+            bool res = cached && cached->size == content.size && cached->hash == content.hash;
+
+            if(bytes) {
+                hashed.fetch_add(1, std::memory_order_relaxed);
+                hashedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            }
+
+            if(cached) {
+                *cached = content;
+            } else if(cache.store(path, content)) {
+                evicted.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            entries.store(cache.size(), std::memory_order_relaxed);
+
+            // the merged event with the other changes is not dropped
+            return res && 0 == (mask & ~(IN_CLOSE_WRITE | IN_MODIFY));
+        }
+
+        void handle(const std::string & path, uint32_t mask, const std::string & from) {
+            if(same(path, mask, from)) {
+                unchanged.fetch_add(1, std::memory_order_relaxed);
+                metrics->unchanged.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            std::scoped_lock guard{ lock };
+
+            if(! stopped) {
+                passCb(path, mask, from);
+            }
+        }
+    };
+
+    UnchangedFilter::UnchangedFilter(asio::thread_pool & pool, size_t capacity, JobMetricsPtr metrics, UnchangedPassCb && func)
+        : state_(std::make_shared<State>(pool, capacity, std::move(metrics), std::move(func))) {
+    }
+
+    UnchangedFilter::~UnchangedFilter() {
+        std::scoped_lock guard{ state_->lock };
+        state_->stopped = true;
+    }
+
+    void UnchangedFilter::push(std::string_view path, uint32_t mask, std::string_view from) {
+        // the events of the job in order, the other jobs in parallel
+        asio::post(state_->strand, [state = state_, path = std::string(path), mask, from = std::string(from)]() {
+            // the job removed: not hashed
+            if(! state->stopped) {
+                state->handle(path, mask, from);
+            }
+        });
+    }
+
+    void UnchangedFilter::status(const std::string & job) const {
+        spdlog::info("{}: job: {}, cached: {}, hashed: {}, bytes: {}, unchanged: {}, evicted: {}", "UnchangedFilter", job,
+                        state_->entries.load(), state_->hashed.load(), state_->hashedBytes.load(), state_->unchanged.load(), state_->evicted.load());
+    }
+}
@@ -0,0 +1,102 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_UNCHANGED_H_
+#define INOTIFY_UNCHANGED_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include "inotify_metrics.h"
+
+namespace Inotify {
+    /// xxh64, streaming
+    class Xxh64 {
+        uint64_t acc_[4];
+        uint64_t seed_;
+        uint64_t total_ = 0;
+        uint8_t mem_[32];
+        size_t memSize_ = 0;
+
+      public:
+        explicit Xxh64(uint64_t seed = 0);
+
+        void update(const void*, size_t);
+        uint64_t digest(void) const;
+    };
+
+    uint64_t xxh64(const void*, size_t, uint64_t seed = 0);
+
+    /// the file content id: the stat and the hash of the content
+    struct Content {
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        int64_t ctime = 0;
+        uint64_t hash = 0;
+        // the coarse realtime before the hash, ns
+        int64_t checked = 0;
+    };
+
+    /// the last content of the paths, LRU, one thread
+    class ContentCache : boost::noncopyable {
+        using Node = std::pair<std::string, Content>;
+
+        std::list<Node> order_;
+        // the key points to the node string
+        std::unordered_map<std::string_view, std::list<Node>::iterator> index_;
+        const size_t capacity_;
+
+      public:
+        explicit ContentCache(size_t capacity) : capacity_(capacity) {}
+
+        /// nullptr: unknown, the entry becomes the most recent
+        Content* find(std::string_view path);
+        /// return true: the oldest entry evicted
+        bool store(std::string_view path, const Content &);
+        void forget(std::string_view path);
+
+        size_t size(void) const {
+            return index_.size();
+        }
+    };
+
+    /// false: the file is not readable
+    bool readContent(const std::string & path, const Content* cached, Content & res, uint64_t & hashed);
+
+    using UnchangedPassCb = std::function<void(const std::string & path, uint32_t mask, const std::string & from)>;
+
+    /// drop the IN_CLOSE_WRITE of the rewrite with the same content,
+    /// the files are hashed on the pool, the events of one job pass in order
+    class UnchangedFilter : boost::noncopyable {
+        struct State;
+        std::shared_ptr<State> state_;
+
+      public:
+        UnchangedFilter(boost::asio::thread_pool &, size_t capacity, JobMetricsPtr, UnchangedPassCb &&);
+        /// the pending events are dropped, the running callback is waited
+        ~UnchangedFilter();
+
+        void push(std::string_view path, uint32_t mask, std::string_view from);
+        void status(const std::string & job) const;
+    };
+}
+
+#endif // INOTIFY_UNCHANGED_H_
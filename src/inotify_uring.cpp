@@ -0,0 +1,541 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+
+#include "inotify_metrics.h"
+#include "inotify_uring.h"
+
+#ifdef INOTIFY_WATCHER_IO_URING
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+using namespace boost;
+
+namespace Inotify {
+#ifdef INOTIFY_WATCHER_IO_URING
+    // user_data of the poll linked before the read
+    const uint64_t POLL_BIT = 1ull << 63;
+
+    // without liburing: the syscalls and the ring layout of the kernel uapi
+    static int uringSetup(unsigned entries, struct io_uring_params* params) {
+        return syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    static int uringEnter(int fd, unsigned submit, unsigned min_complete, unsigned flags) {
+        return syscall(__NR_io_uring_enter, fd, submit, min_complete, flags, nullptr, 0);
+    }
+
+    static int uringRegister(int fd, unsigned opcode, void* arg, unsigned args) {
+        return syscall(__NR_io_uring_register, fd, opcode, arg, args);
+    }
+
+    /* UringRing */
+    UringRing::UringRing(unsigned entries) {
+        struct io_uring_params params;
+        memset(& params, 0, sizeof(params));
+
+        ringFd_ = uringSetup(entries, & params);
+
+        if(0 > ringFd_) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "io_uring_setup", strerror(errno), errno);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        // 5.4: the sq and the cq rings are one mapping
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        }
+
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+
+        if(sqRing_ != MAP_FAILED) {
+            cqRing_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing_ :
+                        mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        }
+
+        sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+
+        if(sqRing_ != MAP_FAILED && cqRing_ != MAP_FAILED) {
+            sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+        }
+
+        if(sqRing_ == MAP_FAILED || cqRing_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "mmap", strerror(errno), errno);
+
+            if(sqRing_ != MAP_FAILED) {
+                munmap(sqRing_, sqRingSize_);
+            }
+
+            if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_ && cqRing_) {
+                munmap(cqRing_, cqRingSize_);
+            }
+
+            close(ringFd_);
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        auto sq = static_cast<char*>(sqRing_);
+        sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<char*>(cqRing_);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        features_ = params.features;
+    }
+
+    UringRing::~UringRing() {
+        munmap(sqes_, sqesSize_);
+        munmap(sqRing_, sqRingSize_);
+
+        if(cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingSize_);
+        }
+
+        close(ringFd_);
+    }
+
+    io_uring_sqe* UringRing::nextSqe(void) {
+        unsigned tail = *sqTail_;
+
+        // the ring full: the queued entries to the kernel
+        if(tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+            submit();
+        }
+
+        auto sqe = & sqes_[tail & sqMask_];
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqArray_[tail & sqMask_] = tail & sqMask_;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        queued_++;
+
+        return sqe;
+    }
+
+    void UringRing::submit(void) {
+        while(queued_) {
+            int res = uringEnter(ringFd_, queued_, 0, 0);
+
+            if(0 > res) {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "io_uring_enter", strerror(errno), errno);
+                return;
+            }
+
+            metrics().ringSubmits.fetch_add(1, std::memory_order_relaxed);
+            queued_ -= std::min(queued_, static_cast<unsigned>(res));
+        }
+    }
+
+    /* UringScan */
+    UringScan::UringScan(unsigned entries) : UringRing(entries) {
+    }
+
+    void UringScan::complete(unsigned count, const std::function<void(uint64_t, int)> & func) {
+        submit();
+
+        while(count) {
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+            if(head == tail) {
+                // EAGAIN, EBUSY: the cq overflow is flushed, waited again
+                if(0 > uringEnter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS) && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "io_uring_enter", strerror(errno), errno);
+                    throw std::runtime_error(__FUNCTION__);
+                }
+
+                continue;
+            }
+
+            for(; head != tail && count; ++head, --count) {
+                func(cqes_[head & cqMask_].user_data, cqes_[head & cqMask_].res);
+                metrics().ringCompletions.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    int UringScan::openAt(int dirfd, const char* path, int flags) {
+        auto sqe = nextSqe();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = dirfd;
+        sqe->addr = reinterpret_cast<uint64_t>(path);
+        sqe->open_flags = flags;
+
+        int fd = -ENOSYS;
+
+        complete(1, [&](uint64_t, int res) {
+            fd = res;
+        });
+
+        return fd;
+    }
+
+    void UringScan::statAt(int dirfd, std::vector<UringStat> & stats) {
+        // by the sq size: the cq is not overflowed
+        for(size_t pos = 0; pos < stats.size(); ) {
+            unsigned count = std::min(stats.size() - pos, static_cast<size_t>(sqEntries_));
+
+            for(unsigned it = 0; it < count; ++it) {
+                auto & st = stats[pos + it];
+
+                auto sqe = nextSqe();
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dirfd;
+                sqe->addr = reinterpret_cast<uint64_t>(st.name);
+                sqe->len = STATX_BASIC_STATS;
+                sqe->off = reinterpret_cast<uint64_t>(& st.stx);
+                sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+                sqe->user_data = pos + it;
+            }
+
+            complete(count, [&](uint64_t index, int res) {
+                stats[index].res = res;
+            });
+
+            pos += count;
+        }
+    }
+
+    /* Uring */
+    Uring::Uring(asio::io_context & ioc, unsigned entries) : UringRing(entries), eventSd_(ioc) {
+        // the completions to the io_context
+        eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if(0 > eventFd_ || 0 > uringRegister(ringFd_, IORING_REGISTER_EVENTFD, & eventFd_, 1)) {
+            spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "register eventfd", strerror(errno), errno);
+
+            if(0 <= eventFd_) {
+                close(eventFd_);
+            }
+
+            // the ring is unmapped by the base
+            throw std::runtime_error(__FUNCTION__);
+        }
+
+        eventSd_.assign(eventFd_);
+        spdlog::info("{}: io_uring entries: {}, features: {:#x}", __FUNCTION__, sqEntries_, features_);
+
+        waitEvents();
+    }
+
+    Uring::~Uring() {
+        system::error_code ec;
+        eventSd_.cancel(ec);
+
+        std::scoped_lock guard{ lock_ };
+
+        // the buffers are in use by the kernel: the reads are canceled and waited
+        for(auto & [id, reader] : readers_) {
+            if(! reader->removed) {
+                reader->removed = true;
+                queueCancel(id);
+            }
+        }
+
+        submit();
+
+        while(inflight_) {
+            if(0 > uringEnter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS) && errno != EINTR) {
+                spdlog::error("{}: {} failed, error: {}, errno: {}", __FUNCTION__, "io_uring_enter", strerror(errno), errno);
+                break;
+            }
+
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+            for(; head != tail; ++head) {
+                if(auto id = cqes_[head & cqMask_].user_data; id && 0 == (id & POLL_BIT)) {
+                    inflight_--;
+                }
+            }
+
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+
+        // eventSd_ owns and closes eventFd_, the ring is unmapped by the base
+    }
+
+    void Uring::queueRead(uint64_t id, Reader & reader) {
+        if(! reader.buf) {
+            auto sqe = nextSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = reader.fd;
+            sqe->poll_events = POLLIN;
+            sqe->user_data = id;
+
+            inflight_++;
+            return;
+        }
+
+        // the poll and the read in one submit: the link is not split
+        if(*sqTail_ + 2 - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) > sqEntries_) {
+            submit();
+        }
+
+        // the inotify descriptor is nonblocking: the read alone may complete at once with EAGAIN,
+        // the linked poll waits the events, the read runs after it
+        auto poll = nextSqe();
+        poll->opcode = IORING_OP_POLL_ADD;
+        poll->fd = reader.fd;
+        poll->poll_events = POLLIN;
+        poll->flags = IOSQE_IO_LINK;
+        poll->user_data = id | POLL_BIT;
+
+        auto sqe = nextSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = reader.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(reader.buf.get());
+        sqe->len = reader.size;
+        // the stream: the current position
+        sqe->off = static_cast<uint64_t>(-1);
+        sqe->user_data = id;
+
+        inflight_++;
+    }
+
+    void Uring::queueCancel(uint64_t id) {
+        // the pending poll: the linked read completes with ECANCELED
+        auto sqe = nextSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = id | POLL_BIT;
+
+        // the started read
+        sqe = nextSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = id;
+    }
+
+    void Uring::waitEvents(void) {
+        // the speculative read first: the completion before the wait is not lost
+        eventSd_.async_read_some(asio::buffer(& eventValue_, sizeof(eventValue_)), [this](const system::error_code & ec, size_t) {
+            if(ec) {
+                if(ec != asio::error::operation_aborted) {
+                    spdlog::error("{}: {} error, code: {}, message: {}", "Uring", "eventfd read", ec.value(), ec.message());
+                }
+
+                return;
+            }
+
+            this->reapEvents();
+            this->waitEvents();
+        });
+    }
+
+    void Uring::reapEvents(void) {
+        std::unique_lock guard{ lock_ };
+        reaping_ = std::this_thread::get_id();
+
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        size_t reaped = 0;
+
+        for(; head != tail; ++head) {
+            auto & cqe = cqes_[head & cqMask_];
+            auto id = cqe.user_data;
+            int res = cqe.res;
+
+            // the cancel result, the poll before the read
+            if(0 == id || (id & POLL_BIT)) {
+                continue;
+            }
+
+            inflight_--;
+            reaped++;
+
+            auto it = readers_.find(id);
+
+            if(it == readers_.end()) {
+                continue;
+            }
+
+            // the element is not moved by the rehash, the iterator may be
+            auto & reader = *it->second;
+
+            if(reader.removed) {
+                readers_.erase(it);
+                continue;
+            }
+
+            // the interrupted or the spurious wakeup: the read is rearmed behind the poll, not busy
+            bool next = true;
+
+            if(0 < res || (res != -EINTR && res != -EAGAIN)) {
+                // without the lock: the callback may add and remove the readers
+                reader.running = true;
+                reader.result = res;
+                // readyBytes counts the entry by the running reader
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                guard.unlock();
+
+                next = reader.readCb(res, 0 < res ? reader.buf.get() : nullptr) && 0 < res;
+
+                guard.lock();
+                reader.running = false;
+                idle_.notify_all();
+
+                // removed by the callback or waited by removeReader, the wait is one-shot
+                next = next && ! reader.removed && reader.buf;
+            }
+
+            if(next) {
+                queueRead(id, reader);
+            } else {
+                readers_.erase(id);
+            }
+        }
+
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        reaping_ = std::thread::id{};
+
+        metrics().ringCompletions.fetch_add(reaped, std::memory_order_relaxed);
+
+        // all rearmed reads: one syscall
+        submit();
+    }
+
+    uint64_t Uring::addReader(int fd, size_t bufsize, UringReadCb && func) {
+        std::scoped_lock guard{ lock_ };
+
+        auto id = ++seq_;
+        auto reader = std::make_unique<Reader>();
+        reader->fd = fd;
+        reader->buf = std::make_unique<char[]>(bufsize);
+        reader->size = bufsize;
+        reader->readCb = std::move(func);
+
+        queueRead(id, *reader);
+        readers_.emplace(id, std::move(reader));
+        submit();
+
+        return id;
+    }
+
+    uint64_t Uring::addWait(int fd, UringReadCb && func) {
+        std::scoped_lock guard{ lock_ };
+
+        auto id = ++seq_;
+        auto reader = std::make_unique<Reader>();
+        reader->fd = fd;
+        reader->readCb = std::move(func);
+
+        queueRead(id, *reader);
+        readers_.emplace(id, std::move(reader));
+        submit();
+
+        return id;
+    }
+
+    void Uring::removeReader(uint64_t id) {
+        std::unique_lock guard{ lock_ };
+
+        if(auto it = readers_.find(id); it != readers_.end() && ! it->second->removed) {
+            it->second->removed = true;
+            queueCancel(id);
+            submit();
+        }
+
+        // the callback of the other thread is finished, from the callback itself: not waited
+        if(reaping_ != std::this_thread::get_id()) {
+            idle_.wait(guard, [&]() {
+                auto it = readers_.find(id);
+                return it == readers_.end() || ! it->second->running;
+            });
+        }
+    }
+
+    size_t Uring::readyBytes(uint64_t id) {
+        std::scoped_lock guard{ lock_ };
+        size_t bytes = 0;
+
+        if(auto it = readers_.find(id); it != readers_.end() && it->second->running && 0 < it->second->result) {
+            bytes += it->second->result;
+        }
+
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+
+        for(unsigned head = *cqHead_; head != tail; ++head) {
+            if(auto & cqe = cqes_[head & cqMask_]; cqe.user_data == id && 0 < cqe.res) {
+                bytes += cqe.res;
+            }
+        }
+
+        return bytes;
+    }
+
+    bool Uring::supported(void) {
+        return true;
+    }
+#else
+    UringRing::UringRing(unsigned entries) {
+        spdlog::error("{}: io_uring not supported, the build without INOTIFY_WATCHER_IO_URING", __FUNCTION__);
+        throw std::runtime_error(__FUNCTION__);
+    }
+
+    UringRing::~UringRing() {}
+
+    UringScan::UringScan(unsigned entries) : UringRing(entries) {}
+
+    void UringScan::complete(unsigned count, const std::function<void(uint64_t, int)> & func) {}
+
+    int UringScan::openAt(int dirfd, const char* path, int flags) {
+        return -ENOSYS;
+    }
+
+    void UringScan::statAt(int dirfd, std::vector<UringStat> & stats) {}
+
+    Uring::Uring(asio::io_context & ioc, unsigned entries) : UringRing(entries), eventSd_(ioc) {}
+
+    Uring::~Uring() {}
+
+    uint64_t Uring::addReader(int fd, size_t bufsize, UringReadCb && func) {
+        return 0;
+    }
+
+    uint64_t Uring::addWait(int fd, UringReadCb && func) {
+        return 0;
+    }
+
+    void Uring::removeReader(uint64_t id) {}
+
+    size_t Uring::readyBytes(uint64_t id) {
+        return 0;
+    }
+
+    bool Uring::supported(void) {
+        return false;
+    }
+#endif
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_URING_H_
+#define INOTIFY_URING_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <sys/stat.h>
+
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace Inotify {
+    /// res: the read bytes or -errno, the data is valid for the call only
+    /// return false: the reads are stopped
+    using UringReadCb = std::function<bool(int res, const char* data)>;
+
+    /// the ring mapping: the raw syscalls and the sq/cq layout of the kernel uapi, without liburing
+    class UringRing : boost::noncopyable {
+      protected:
+        int ringFd_ = -1;
+        unsigned features_ = 0;
+
+        void* sqRing_ = nullptr;
+        size_t sqRingSize_ = 0;
+        void* cqRing_ = nullptr;
+        size_t cqRingSize_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        size_t sqesSize_ = 0;
+
+        unsigned* sqHead_ = nullptr;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+        unsigned cqMask_ = 0;
+
+        // the queued sqes, not submitted
+        unsigned queued_ = 0;
+
+        io_uring_sqe* nextSqe(void);
+        void submit(void);
+
+      public:
+        /// throw: the kernel without io_uring or the build without INOTIFY_WATCHER_IO_URING
+        explicit UringRing(unsigned entries);
+        virtual ~UringRing();
+    };
+
+    /// the statx result of the one name
+    struct UringStat {
+        const char* name = nullptr;
+        struct statx stx;
+        // 0 or -errno
+        int res = 0;
+    };
+
+    /// the scan ring of the one thread: the openat and the statx batches are submitted and waited in the caller thread,
+    /// one io_uring_enter for the batch instead of the syscall per entry
+    class UringScan : public UringRing {
+      protected:
+        /// the count completions: the callback with user_data and res
+        void complete(unsigned count, const std::function<void(uint64_t, int)> &);
+
+      public:
+        explicit UringScan(unsigned entries = 128);
+
+        /// return: the descriptor or -errno
+        int openAt(int dirfd, const char* path, int flags);
+        /// AT_SYMLINK_NOFOLLOW, the names relative to dirfd
+        void statAt(int dirfd, std::vector<UringStat> &);
+    };
+
+    /// the io_uring engine of the inotify descriptors and the pidfd waits:
+    /// the reads of all descriptors are queued to one ring, each behind the linked poll,
+    /// the completions are reaped and the reads are rearmed by one io_uring_enter,
+    /// the ring completions wake the io_context by the eventfd
+    class Uring : public UringRing {
+        struct Reader {
+            int fd = -1;
+            // nullptr: the one-shot poll wait
+            std::unique_ptr<char[]> buf;
+            size_t size = 0;
+            UringReadCb readCb;
+            // the cancel is queued, the buffer is freed by the completion
+            bool removed = false;
+            // the callback is called without the lock
+            bool running = false;
+            // the result of the running callback
+            int result = 0;
+        };
+
+        int eventFd_ = -1;
+
+        boost::asio::posix::stream_descriptor eventSd_;
+        uint64_t eventValue_ = 0;
+
+        std::mutex lock_;
+        // the callback finished
+        std::condition_variable idle_;
+        std::thread::id reaping_;
+        // user_data: the reader id, 0: the cancel
+        std::unordered_map<uint64_t, std::unique_ptr<Reader>> readers_;
+        uint64_t seq_ = 0;
+        // the reads in the kernel
+        size_t inflight_ = 0;
+
+      protected:
+        void queueRead(uint64_t id, Reader &);
+        void queueCancel(uint64_t id);
+        void waitEvents(void);
+        void reapEvents(void);
+
+      public:
+        /// throw: the kernel without io_uring or the build without INOTIFY_WATCHER_IO_URING
+        Uring(boost::asio::io_context &, unsigned entries = 256);
+        ~Uring();
+
+        /// the nonblocking descriptor is read continuously, the callback runs on the io_context thread
+        uint64_t addReader(int fd, size_t bufsize, UringReadCb &&);
+        /// the one-shot poll of the readable descriptor (the pidfd exit): res: the poll mask or -errno, the data is nullptr
+        uint64_t addWait(int fd, UringReadCb &&);
+
+        /// the reader or the wait: the callback is not called after the return, the running one is waited, the reader owns no descriptor
+        void removeReader(uint64_t id);
+        /// the bytes read by the kernel and not passed to the callback yet: the reaped and the running completions
+        size_t readyBytes(uint64_t id);
+
+        static bool supported(void);
+    };
+}
+
+#endif // INOTIFY_URING_H_
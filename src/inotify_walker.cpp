@@ -0,0 +1,366 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_walker.h"
+
+namespace System {
+    // the parent dirs kept open for the subdirs, over it the subdir is opened by the full path
+    const size_t WALK_OPEN_DIRS = 64;
+
+    struct linux_dirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    // the scanned dir: kept open while its subdirs are queued
+    struct DirFd {
+        const int fd;
+        std::atomic<size_t> & opened;
+
+        DirFd(int val, std::atomic<size_t> & count) : fd(val), opened(count) { opened.fetch_add(1); }
+        ~DirFd() { close(fd); opened.fetch_sub(1); }
+    };
+
+    using DirFdPtr = std::shared_ptr<DirFd>;
+
+    struct WalkDir {
+        std::string path;
+        // the subdir is opened by the name relative to it, nullptr: by the full path
+        DirFdPtr parent;
+    };
+
+    class DirWalker {
+        struct Worker {
+            std::mutex lock;
+            std::deque<WalkDir> dirs;
+        };
+
+        // the parents held by the queued subdirs, outlives the queues
+        std::atomic<size_t> opened_{0};
+        std::vector<std::unique_ptr<Worker>> workers_;
+
+        // queued and in progress directories, 0: the walk is complete
+        std::atomic<size_t> pending_{0};
+        std::atomic<size_t> dirs_{0};
+        std::atomic<size_t> entries_{0};
+        std::atomic<size_t> errors_{0};
+        std::atomic<bool> stopped_{false};
+
+        const size_t batch_;
+        const WalkBatchCb & batchCb_;
+        const WalkStopCb & stopCb_;
+        const WalkPruneCb & pruneCb_;
+
+        // the subdirs levels, 0: unlimited
+        const size_t maxDepth_;
+        size_t rootLen_ = 0;
+
+      protected:
+        void push(size_t id, WalkDir && dir) {
+            pending_.fetch_add(1);
+            std::scoped_lock guard{ workers_[id]->lock };
+            workers_[id]->dirs.emplace_back(std::move(dir));
+        }
+
+        bool pop(size_t id, WalkDir & dir) {
+            // own queue: depth first
+            if(std::scoped_lock guard{ workers_[id]->lock }; ! workers_[id]->dirs.empty()) {
+                dir = std::move(workers_[id]->dirs.back());
+                workers_[id]->dirs.pop_back();
+                return true;
+            }
+
+            // steal: breadth first, the large subtrees
+            for(size_t it = 1; it < workers_.size(); ++it) {
+                auto & other = *workers_[(id + it) % workers_.size()];
+                std::scoped_lock guard{ other.lock };
+
+                if(! other.dirs.empty()) {
+                    dir = std::move(other.dirs.front());
+                    other.dirs.pop_front();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        int openDir(const WalkDir & dir) const {
+            const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+            if(dir.parent) {
+                // the name only: the path is not resolved again
+                int fd = openat(dir.parent->fd, dir.path.c_str() + dir.path.rfind('/') + 1, flags);
+
+                // the parents are kept open: the fd limit, by the full path
+                if(0 <= fd || (errno != EMFILE && errno != ENFILE)) {
+                    return fd;
+                }
+            }
+
+            // the root symlink is followed
+            return open(dir.path.c_str(), dir.path.size() > rootLen_ + 1 ? flags : flags & ~O_NOFOLLOW);
+        }
+
+        void scan(size_t id, const WalkDir & walk, std::vector<char> & buf) {
+            const std::string & dir = walk.path;
+            int fd = openDir(walk);
+
+            if(0 > fd) {
+                // removed or replaced by the symlink while walking
+                if(errno != ENOENT && errno != ENOTDIR && errno != ELOOP) {
+                    spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "open", strerror(errno), errno, dir);
+                }
+
+                errors_.fetch_add(1);
+                return;
+            }
+
+            // closed after the last queued subdir is opened
+            DirFdPtr self;
+            size_t entries = 0;
+            // the subdirs of the last level are not walked, the root may end with the slash
+            const bool leaf = maxDepth_ && dir.size() > rootLen_ + 1 &&
+                                std::count(dir.begin() + rootLen_, dir.end(), '/') >= static_cast<long>(maxDepth_);
+
+            for(;;) {
+                long len = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+
+                if(0 > len) {
+                    spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "getdents64", strerror(errno), errno, dir);
+                    errors_.fetch_add(1);
+                    break;
+                }
+
+                if(0 == len) {
+                    break;
+                }
+
+                for(long pos = 0; pos < len; ) {
+                    auto ent = reinterpret_cast<const linux_dirent64*>(buf.data() + pos);
+                    pos += ent->d_reclen;
+
+                    const char* name = ent->d_name;
+
+                    if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                        continue;
+                    }
+
+                    entries++;
+                    unsigned char type = ent->d_type;
+
+                    // some filesystems do not fill d_type
+                    if(type == DT_UNKNOWN) {
+                        struct stat st;
+
+                        if(0 == fstatat(fd, name, & st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode)) {
+                            type = DT_DIR;
+                        }
+                    }
+
+                    if(type == DT_DIR && ! leaf && ! (pruneCb_ && pruneCb_(name))) {
+                        std::string sub;
+                        sub.reserve(dir.size() + strlen(name) + 1);
+                        sub.append(dir);
+
+                        if(sub.back() != '/') {
+                            sub.push_back('/');
+                        }
+
+                        if(! self && opened_ < WALK_OPEN_DIRS) {
+                            self = std::make_shared<DirFd>(fd, opened_);
+                        }
+
+                        push(id, WalkDir{ std::move(sub.append(name)), self });
+                    }
+                }
+            }
+
+            if(! self) {
+                close(fd);
+            }
+
+            dirs_.fetch_add(1);
+            entries_.fetch_add(entries);
+        }
+
+        bool stopped(void) {
+            if(! stopped_ && stopCb_ && stopCb_()) {
+                stopped_ = true;
+            }
+
+            return stopped_;
+        }
+
+        void run(size_t id) {
+            std::vector<char> buf(64 * 1024);
+            std::vector<std::string> batch;
+            WalkDir dir;
+            size_t idle = 0;
+
+            batch.reserve(batch_);
+
+            while(0 < pending_ && ! stopped()) {
+                if(! pop(id, dir)) {
+                    // nothing to steal: give the found dirs out
+                    if(! batch.empty()) {
+                        batchCb_(std::move(batch));
+                        batch.clear();
+                    }
+
+                    if(++idle < 64) {
+                        std::this_thread::yield();
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+
+                    continue;
+                }
+
+                idle = 0;
+                scan(id, dir, buf);
+                dir.parent.reset();
+                batch.emplace_back(std::move(dir.path));
+
+                if(batch.size() >= batch_) {
+                    batchCb_(std::move(batch));
+                    batch.clear();
+                    batch.reserve(batch_);
+                }
+
+                // after the subdirs are pushed
+                pending_.fetch_sub(1);
+            }
+
+            if(! batch.empty() && ! stopped_) {
+                batchCb_(std::move(batch));
+            }
+        }
+
+      public:
+        DirWalker(size_t threads, size_t batch, const WalkBatchCb & batchCb, const WalkStopCb & stopCb, const WalkPruneCb & pruneCb, size_t max_depth)
+            : batch_(std::max(batch, size_t(1))), batchCb_(batchCb), stopCb_(stopCb), pruneCb_(pruneCb), maxDepth_(max_depth) {
+            for(size_t it = 0; it < std::max(threads, size_t(1)); ++it) {
+                workers_.emplace_back(std::make_unique<Worker>());
+            }
+        }
+
+        WalkStats walk(const std::filesystem::path & root) {
+            auto start = std::chrono::steady_clock::now();
+
+            rootLen_ = root.native().size();
+
+            if(rootLen_ && root.native().back() == '/') {
+                rootLen_--;
+            }
+
+            push(0, WalkDir{ root.native(), nullptr });
+
+            std::vector<std::thread> threads;
+
+            for(size_t id = 1; id < workers_.size(); ++id) {
+                threads.emplace_back(&DirWalker::run, this, id);
+            }
+
+            run(0);
+
+            for(auto & thread : threads) {
+                thread.join();
+            }
+
+            WalkStats stats;
+            stats.dirs = dirs_;
+            stats.entries = entries_;
+            stats.errors = errors_;
+            stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+            return stats;
+        }
+    };
+
+    WalkStats walkDirs(const std::filesystem::path & root, size_t threads, size_t batch, WalkBatchCb && batchCb, WalkStopCb && stopCb, WalkPruneCb && pruneCb, size_t max_depth) {
+        DirWalker walker(threads, batch, batchCb, stopCb, pruneCb, max_depth);
+        return walker.walk(root);
+    }
+
+    long listDir(const std::string & dir, const ListEntryCb & entryCb) {
+        // the new subdir replaced by the symlink is not followed
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+        if(0 > fd) {
+            return -1;
+        }
+
+        // the event handler threads, the new dirs are small
+        thread_local std::vector<char> buf(16 * 1024);
+        long entries = 0;
+
+        for(;;) {
+            long len = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+
+            if(0 > len) {
+                spdlog::warn("{}: {} failed, error: {}, errno: {}, path: {}", __FUNCTION__, "getdents64", strerror(errno), errno, dir);
+                break;
+            }
+
+            if(0 == len) {
+                break;
+            }
+
+            for(long pos = 0; pos < len; ) {
+                auto ent = reinterpret_cast<const linux_dirent64*>(buf.data() + pos);
+                pos += ent->d_reclen;
+
+                const char* name = ent->d_name;
+
+                if(name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+                    continue;
+                }
+
+                unsigned char type = ent->d_type;
+
+                if(type == DT_UNKNOWN) {
+                    struct stat st;
+
+                    if(0 == fstatat(fd, name, & st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode)) {
+                        type = DT_DIR;
+                    }
+                }
+
+                entryCb(name, type == DT_DIR);
+                entries++;
+            }
+        }
+
+        close(fd);
+        return entries;
+    }
+}
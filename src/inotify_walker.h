@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_WALKER_H_
+#define INOTIFY_WALKER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <string_view>
+#include <filesystem>
+
+namespace System {
+    struct WalkStats {
+        size_t dirs = 0;
+        size_t entries = 0;
+        size_t errors = 0;
+        std::chrono::milliseconds elapsed{0};
+
+        size_t entriesPerSec(void) const {
+            return elapsed.count() ? entries * 1000 / elapsed.count() : entries;
+        }
+    };
+
+    /// called from the walker threads with the found directories
+    using WalkBatchCb = std::function<void(std::vector<std::string> &&)>;
+    /// return true: abort the walk
+    using WalkStopCb = std::function<bool(void)>;
+    /// return true: skip the subdirectory with the name
+    using WalkPruneCb = std::function<bool(std::string_view)>;
+
+    /// parallel recursive walk of the directory tree, the root included
+    /// the threads steal the directories from each other, getdents64 with d_type without stat,
+    /// the found directories are streamed by batches while the walk is running, symlinks are not followed
+    /// the subdir is opened by its name relative to the open parent (openat, O_NOFOLLOW)
+    /// max_depth: the subdirs levels below the root, 0: unlimited
+    WalkStats walkDirs(const std::filesystem::path & root, size_t threads, size_t batch, WalkBatchCb &&, WalkStopCb && = nullptr, WalkPruneCb && = nullptr, size_t max_depth = 0);
+
+    /// the entry name (valid for the call only) and the directory flag
+    using ListEntryCb = std::function<void(const char* name, bool dir)>;
+
+    /// the entries of the one directory, getdents64 with d_type, in the caller thread
+    /// return: the entries count, or -1 on the open error
+    long listDir(const std::string & dir, const ListEntryCb &);
+}
+
+#endif // INOTIFY_WALKER_H_
@@ -0,0 +1,339 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <charconv>
+
+#include <spdlog/spdlog.h>
+
+#include "inotify_tools.h"
+#include "inotify_worker.h"
+
+using namespace boost;
+
+namespace System {
+    // the spare records kept with the unlimited queue
+    const size_t WORKER_SPARE_MAX = 4096;
+    // the initial record capacity: the json frame and the path
+    const size_t WORKER_RECORD_RESERVE = 256;
+    // the records per write
+    const size_t WORKER_WRITE_RECORDS = 64;
+
+    // the worker ran longer: the backoff is reset
+    const std::chrono::seconds WORKER_STABLE{10};
+    const std::chrono::milliseconds WORKER_BACKOFF_MIN{100};
+    const std::chrono::milliseconds WORKER_BACKOFF_MAX{30000};
+
+    Worker::Worker(asio::io_context & ioc, ProcessReaper & reaper, Command && cmd, WorkerFormat format, size_t max_queue,
+                    Inotify::JobMetricsPtr metrics, WorkerAckCb ack)
+        : reaper_(reaper), cmd_(std::move(cmd)), format_(format), maxQueue_(max_queue), metrics_(std::move(metrics)), ackCb_(std::move(ack)),
+            strand_(asio::make_strand(ioc)), timer_(strand_),
+            postMemory_(std::make_shared<Inotify::HandlerMemory>(2, 128)), writeMemory_(std::make_shared<Inotify::HandlerMemory>(2, 640)) {
+        spareMax_ = maxQueue_ ? maxQueue_ : WORKER_SPARE_MAX;
+        writeBufs_.reserve(WORKER_WRITE_RECORDS);
+    }
+
+    void Worker::run(void) {
+        asio::post(strand_, std::bind(& Worker::start, shared_from_this()));
+    }
+
+    void Worker::stop(void) {
+        asio::post(strand_, [self = shared_from_this()]() {
+            self->stopped_ = true;
+            self->timer_.cancel();
+            self->closePipe();
+        });
+    }
+
+    void Worker::start(void) {
+        if(stopped_) {
+            return;
+        }
+
+        int stdinfd = -1;
+        // the exit callback holds the worker
+        pid_ = reaper_.runWorker(cmd_, stdinfd, [self = shared_from_this()](pid_t pid, int status, std::chrono::milliseconds runtime) {
+            if(self->metrics_ && status) {
+                self->metrics_->failed.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            asio::post(self->strand_, std::bind(& Worker::workerExit, self, pid, status, runtime));
+        });
+
+        if(metrics_) {
+            (0 > pid_ ? metrics_->failed : metrics_->spawned).fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if(0 > pid_) {
+            workerExit(-1, 0, std::chrono::milliseconds(0));
+            return;
+        }
+
+        size_t queued = 0;
+
+        {
+            std::scoped_lock guard{ lock_ };
+            queued = queue_.size();
+        }
+
+        spdlog::info("{}: pid: {}, cmd: {}, queued: {}", __FUNCTION__, pid_, cmd_.cmd, queued);
+
+        // the io_context executor: the strand is bound to the handlers, the type erased strand allocates
+        pipe_ = std::make_unique<asio::posix::stream_descriptor>(strand_.get_inner_executor(), stdinfd);
+        writeNext();
+    }
+
+    void Worker::closePipe(void) {
+        if(pipe_) {
+            pipe_->close();
+            pipe_.reset();
+        }
+
+        // the aborted write is ignored
+        writing_ = false;
+        generation_++;
+    }
+
+    void Worker::workerExit(pid_t pid, int status, std::chrono::milliseconds runtime) {
+        pid_ = -1;
+        closePipe();
+
+        if(stopped_) {
+            return;
+        }
+
+        backoff_ = runtime >= WORKER_STABLE ? WORKER_BACKOFF_MIN :
+                    std::min(std::max(backoff_ * 2, WORKER_BACKOFF_MIN), WORKER_BACKOFF_MAX);
+        restarts_++;
+
+        spdlog::warn("{}: restart after: {}ms, cmd: {}, restarts: {}", __FUNCTION__, backoff_.count(), cmd_.cmd, restarts_);
+
+        timer_.expires_after(backoff_);
+        timer_.async_wait([self = shared_from_this()](const system::error_code & ec) {
+            if(! ec) {
+                self->start();
+            }
+        });
+    }
+
+    // the buffers view: async_write keeps a copy of the sequence, the vector copy allocates
+    struct BufferSpan {
+        using value_type = asio::const_buffer;
+        using const_iterator = const asio::const_buffer*;
+
+        const_iterator first;
+        const_iterator last;
+
+        const_iterator begin(void) const { return first; }
+        const_iterator end(void) const { return last; }
+    };
+
+    // json string: the quotes, the escapes and the control chars
+    static void appendJsonString(std::string & out, std::string_view str) {
+        const char* hex = "0123456789abcdef";
+        out.push_back('"');
+
+        for(auto ch : str) {
+            switch(ch) {
+                case '"':
+                    out.append("\\\"");
+                    break;
+
+                case '\\':
+                    out.append("\\\\");
+                    break;
+
+                case '\n':
+                    out.append("\\n");
+                    break;
+
+                case '\r':
+                    out.append("\\r");
+                    break;
+
+                case '\t':
+                    out.append("\\t");
+                    break;
+
+                default:
+                    if(0x20 > static_cast<unsigned char>(ch)) {
+                        out.append("\\u00").append(1, hex[(ch >> 4) & 0x0F]).append(1, hex[ch & 0x0F]);
+                    } else {
+                        out.push_back(ch);
+                    }
+                    break;
+            }
+        }
+
+        out.push_back('"');
+    }
+
+    void formatRecord(std::string & record, WorkerFormat format, std::string_view path, uint32_t mask, std::string_view from) {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record.clear();
+
+        if(format == WorkerFormat::Binary) {
+            // the rename: path NUL from
+            const uint32_t size = 16 + path.size() + (from.size() ? 1 + from.size() : 0);
+            const uint64_t time = now;
+
+            record.append(reinterpret_cast<const char*>(& size), sizeof(size));
+            record.append(reinterpret_cast<const char*>(& mask), sizeof(mask));
+            record.append(reinterpret_cast<const char*>(& time), sizeof(time));
+            record.append(path);
+
+            if(from.size()) {
+                record.push_back(0);
+                record.append(from);
+            }
+        } else {
+            record.append("{\"event\":\"");
+
+            // the debounced events: IN_MODIFY|IN_CLOSE_WRITE
+            if(mask & (mask - 1)) {
+                record.append(Inotify::maskToString(mask));
+            } else {
+                record.append(Inotify::maskToName(mask));
+            }
+
+            record.append("\",\"path\":");
+            appendJsonString(record, path);
+
+            if(from.size()) {
+                record.append(",\"from\":");
+                appendJsonString(record, from);
+            }
+
+            char buf[24];
+            auto res = std::to_chars(buf, buf + sizeof(buf), now);
+
+            record.append(",\"time\":").append(buf, res.ptr).append("}\n");
+        }
+    }
+
+    void Worker::push(std::string_view path, uint32_t mask, uint64_t seq, std::string_view from) {
+        std::scoped_lock guard{ lock_ };
+
+        if(maxQueue_ && queue_.size() >= maxQueue_) {
+            if(System::logThrottled(dropped_)) {
+                spdlog::warn("{}: queue full, size: {}, cmd: {}, dropped: {}", __FUNCTION__, queue_.size(), cmd_.cmd, dropped_);
+            }
+
+            if(metrics_) {
+                metrics_->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return;
+        }
+
+        if(spare_.empty()) {
+            spare_.emplace_back().data.reserve(WORKER_RECORD_RESERVE);
+        }
+
+        // framed in the caller thread
+        formatRecord(spare_.front().data, format_, path, mask, from);
+        spare_.front().seq = seq;
+        queue_.splice(queue_.end(), spare_, spare_.begin());
+
+        if(posted_) {
+            return;
+        }
+
+        posted_ = true;
+
+        asio::post(strand_, Inotify::makeAllocHandler(postMemory_, [self = shared_from_this()]() {
+            {
+                std::scoped_lock guard{ self->lock_ };
+                self->posted_ = false;
+            }
+
+            self->writeNext();
+        }));
+    }
+
+    void Worker::writeNext(void) {
+        if(writing_ || ! pipe_) {
+            return;
+        }
+
+        writeBufs_.clear();
+
+        {
+            std::scoped_lock guard{ lock_ };
+
+            // the front nodes are kept up to the write complete, push appends only
+            for(auto it = queue_.begin(); it != queue_.end() && writeBufs_.size() < WORKER_WRITE_RECORDS; ++it) {
+                writeBufs_.emplace_back(asio::buffer(it->data));
+            }
+        }
+
+        if(writeBufs_.empty()) {
+            return;
+        }
+
+        writing_ = true;
+
+        // gathered, one writev for the queued records
+        BufferSpan bufs{ writeBufs_.data(), writeBufs_.data() + writeBufs_.size() };
+
+        asio::async_write(*pipe_, bufs, asio::bind_executor(strand_, Inotify::makeAllocHandler(writeMemory_,
+            [self = shared_from_this(), generation = generation_, records = writeBufs_.size()](const system::error_code & ec, size_t) {
+                self->writeComplete(generation, records, ec);
+            })));
+    }
+
+    void Worker::writeComplete(uint64_t generation, size_t records, const system::error_code & ec) {
+        if(generation != generation_) {
+            // the pipe closed
+            return;
+        }
+
+        writing_ = false;
+
+        if(ec) {
+            spdlog::warn("{}: pid: {}, {} error, code: {}, message: {}", __FUNCTION__, pid_, "write", ec.value(), ec.message());
+            // the records may be partially written: kept at the front, written again to the restarted worker
+            // wait the exit for restart
+            closePipe();
+            return;
+        }
+
+        {
+            std::scoped_lock guard{ lock_ };
+            auto last = std::next(queue_.begin(), records);
+
+            // in the pipe: the journal records are done
+            if(ackCb_) {
+                for(auto it = queue_.begin(); it != last; ++it) {
+                    if(it->seq) {
+                        ackCb_(it->seq);
+                    }
+                }
+            }
+
+            // the nodes and the capacity are reused, the queue and the spare are limited by max_queue
+            spare_.splice(spare_.begin(), queue_, queue_.begin(), last);
+
+            while(spare_.size() > spareMax_) {
+                spare_.pop_back();
+            }
+        }
+
+        written_ += records;
+        writeNext();
+    }
+
+    void Worker::status(void) {
+        asio::post(strand_, [self = shared_from_this()]() {
+            std::scoped_lock guard{ self->lock_ };
+            spdlog::info("{}: pid: {}, cmd: {}, queued: {}/{}, written: {}, dropped: {}, restarts: {}", "Worker",
+                        self->pid_, self->cmd_.cmd, self->queue_.size(), self->maxQueue_, self->written_, self->dropped_, self->restarts_);
+        });
+    }
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright © 2025 by Andrey Afletdinov <public.irkutsk@gmail.com>      *
+ *                                                                         *
+ *   Part of the InotifyWatcher                                            *
+ *   https://github.com/AndreyBarmaley/inotify-watcher                     *
+ *                                                                         *
+ *   MIT License                                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef INOTIFY_WORKER_H_
+#define INOTIFY_WORKER_H_
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <string_view>
+
+#include "inotify_event.h"
+#include "inotify_metrics.h"
+#include "inotify_process.h"
+
+namespace System {
+    /// json: {"event":"IN_CLOSE_WRITE","path":"/dir/name","time":<unix ns>}\n
+    /// binary: u32 record size, u32 mask, u64 unix ns, path bytes; little endian
+    enum class WorkerFormat { Json, Binary };
+
+    /// the record is replaced, the time is now
+    void formatRecord(std::string &, WorkerFormat, std::string_view path, uint32_t mask, std::string_view from);
+
+    /// the record is written to the pipe: the journal seq
+    using WorkerAckCb = std::function<void(uint64_t seq)>;
+
+    /// long-lived handler process, started once: the events are written to its stdin as framed records
+    /// restarted with backoff on exit, the records are queued (bounded) while the pipe is busy or the worker restarts
+    /// at-least-once: the records of the failed or closed write are kept and written again to the restarted worker,
+    /// the worker exited after the read gets them twice
+    class Worker : boost::noncopyable, public std::enable_shared_from_this<Worker> {
+        struct Record {
+            std::string data;
+            // 0: not journaled
+            uint64_t seq = 0;
+        };
+
+        ProcessReaper & reaper_;
+        const Command cmd_;
+        const WorkerFormat format_;
+        const size_t maxQueue_;
+        const Inotify::JobMetricsPtr metrics_;
+        const WorkerAckCb ackCb_;
+
+        // the records framed by the callers, written on the strand
+        mutable std::mutex lock_;
+        std::list<Record> queue_;
+        // the written records: the list nodes and the string capacity are reused
+        std::list<Record> spare_;
+        bool posted_ = false;
+        size_t spareMax_ = 0;
+        uint64_t dropped_ = 0;
+
+        // all state below: strand only
+        boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+        boost::asio::steady_timer timer_;
+        std::unique_ptr<boost::asio::posix::stream_descriptor> pipe_;
+        std::vector<boost::asio::const_buffer> writeBufs_;
+
+        // one posted writeNext and one write at a time
+        Inotify::HandlerMemoryPtr postMemory_;
+        Inotify::HandlerMemoryPtr writeMemory_;
+
+        pid_t pid_ = -1;
+        bool stopped_ = false;
+        bool writing_ = false;
+        uint64_t generation_ = 0;
+
+        std::chrono::milliseconds backoff_{0};
+
+        uint64_t written_ = 0;
+        uint64_t restarts_ = 0;
+
+      protected:
+        void start(void);
+        void writeNext(void);
+        void writeComplete(uint64_t generation, size_t records, const boost::system::error_code &);
+        void workerExit(pid_t, int status, std::chrono::milliseconds runtime);
+        void closePipe(void);
+
+      public:
+        Worker(boost::asio::io_context &, ProcessReaper &, Command &&, WorkerFormat, size_t max_queue,
+                Inotify::JobMetricsPtr metrics = nullptr, WorkerAckCb ack = nullptr);
+
+        void run(void);
+        /// close the stdin: the worker exits on EOF, not restarted
+        void stop(void);
+
+        /// without allocation in the steady state, from: the old path of the rename
+        void push(std::string_view path, uint32_t mask, uint64_t seq = 0, std::string_view from = {});
+        void status(void);
+    };
+
+    using WorkerPtr = std::shared_ptr<Worker>;
+}
+
+#endif // INOTIFY_WORKER_H_